@@ -0,0 +1,46 @@
+#include "adaptive_ipf.hpp"
+#include <algorithm>
+
+adaptive_ipf::adaptive_ipf(int minimum, int maximum, uint64_t budget_ns)
+    : minimum(minimum), maximum(std::max(minimum, maximum)), current(minimum), budget_ns(budget_ns), frames(0),
+      idle_frames(0), most_executed(0), total_ns(0)
+{
+}
+
+void adaptive_ipf::record(int executed, uint64_t elapsed_ns)
+{
+    frames++;
+    idle_frames += executed < current;
+    most_executed = std::max(most_executed, executed);
+    total_ns += elapsed_ns;
+    if (frames < window)
+    {
+        return;
+    }
+
+    uint64_t mean_ns = total_ns / frames;
+    if (mean_ns > budget_ns)
+    {
+        // the host can't keep up, back off whatever the rom wants
+        current = std::max(minimum, current * 3 / 4);
+    }
+    else if (idle_frames == 0)
+    {
+        // busy every frame, grow by a quarter if the host has room for it at the current cost per instruction
+        int grown = std::min(maximum, current + std::max(1, current / 4));
+        if (mean_ns * grown / current <= budget_ns)
+        {
+            current = grown;
+        }
+    }
+    else if (idle_frames == frames && most_executed * 2 < current)
+    {
+        // idle every frame with plenty to spare, keep twice what the busiest frame needed
+        current = std::max(minimum, most_executed * 2);
+    }
+
+    frames = 0;
+    idle_frames = 0;
+    most_executed = 0;
+    total_ns = 0;
+}
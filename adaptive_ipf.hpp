@@ -0,0 +1,40 @@
+#ifndef adaptive_ipf_h
+#define adaptive_ipf_h
+
+#include <stdint.h>
+
+/* picks instructions per frame for the frontend when the rom's intended speed is unknown
+after every frame it is told how many instructions ran before the rom went idle (see chip8::idle_flag) and how long the
+frame took on the host
+a rom that never goes idle is cpu bound and gets more instructions per frame as long as the host has time for them, one
+that goes idle well before the end of its frames gets fewer, down to twice what it actually used, so a rom paced by the
+delay timer settles where it always has time to finish its frame and a busy one speeds up to what the host can give it
+the ipf always stays between the configured minimum and maximum */
+class adaptive_ipf
+{
+public:
+    // budget_ns is how much host time per frame emulation may take
+    adaptive_ipf(int minimum, int maximum, uint64_t budget_ns);
+
+    void record(int executed, uint64_t elapsed_ns);
+    int ipf() const { return current; }
+    // false when minimum and maximum are the same and record() would never change anything
+    bool adjustable() const { return minimum < maximum; }
+
+    // frames looked at before each adjustment, half a second at 60 Hz
+    static const int window = 30;
+
+private:
+    int minimum;
+    int maximum;
+    int current;
+    uint64_t budget_ns;
+
+    // over the current window
+    int frames;
+    int idle_frames;
+    int most_executed;
+    uint64_t total_ns;
+};
+
+#endif
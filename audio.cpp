@@ -0,0 +1,160 @@
+#include "audio.hpp"
+#include "chip8.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+const double audio_output::target_latency = 0.016;
+const double audio_output::max_latency = 0.040;
+
+// the square wave is kept well below full scale, the pattern is a hard 1-bit signal
+const int16_t amplitude = 4000;
+
+audio_renderer::audio_renderer(int sample_rate, int cycles_per_second)
+    : rate(sample_rate), cycles_per_second(std::max(cycles_per_second, 1)), rendered(0), phase(0), step(0)
+{
+    // clamped since it divides every cycle count, an ipf of 0 from a caller would otherwise raise SIGFPE
+    memset(&current, 0, sizeof(current));
+}
+
+void audio_renderer::update(chip8 &cpu, uint64_t cycle)
+{
+    cpu.sound_flag = false;
+    render_until(cycle);
+    bool was_on = current.on;
+    current.on = cpu.sound_on();
+    current.pitch = cpu.audio_pitch();
+    memcpy(current.pattern, cpu.audio_pattern(), sizeof(current.pattern));
+    step = 4000.0 * pow(2.0, (current.pitch - 64) / 48.0) / rate;
+    // every beep starts at the top of the pattern, so the same run always renders the same samples
+    if (current.on && !was_on)
+    {
+        phase = 0;
+    }
+}
+
+void audio_renderer::render_until(uint64_t cycle)
+{
+    // integer maths so the sample a cycle maps to never drifts, however long the run
+    uint64_t end = cycle * rate / cycles_per_second;
+    if (end <= rendered)
+    {
+        return;
+    }
+    size_t at = samples.size();
+    samples.resize(at + (end - rendered));
+    for (; rendered < end; rendered++, at++)
+    {
+        if (!current.on)
+        {
+            samples[at] = 0;
+            continue;
+        }
+        int bit = (int)phase;
+        samples[at] = (current.pattern[bit >> 3] >> (7 - (bit & 7))) & 1 ? amplitude : -amplitude;
+        phase += step;
+        if (phase >= 128)
+        {
+            phase = fmod(phase, 128);
+        }
+    }
+}
+
+void audio_renderer::skip_until(uint64_t cycle)
+{
+    rendered = std::max(rendered, cycle * rate / cycles_per_second);
+}
+
+audio_output::audio_output(int sample_rate)
+    : dropped(0), held(0), rate(sample_rate), position(0), previous(0), next(0), average_fill(target_latency * sample_rate)
+{
+}
+
+void audio_output::write(const int16_t *data, size_t count)
+{
+    // a full ring only happens when the callback stopped, what does not fit is dropped like any other backlog
+    ring.write(data, count);
+}
+
+void audio_output::read(int16_t *out, int count)
+{
+    double target = target_latency * rate;
+    size_t fill = ring.size();
+    size_t limit = (size_t)(max_latency * rate);
+    if (fill > limit)
+    {
+        // fast-forward, skip the oldest of the backlog rather than play it late, keeping a frame or so more than the target
+        // since the next write is a whole frame away
+        size_t excess = fill - (limit + (size_t)target) / 2;
+        ring.read(NULL, excess);
+        dropped.fetch_add(excess, std::memory_order_relaxed);
+        fill -= excess;
+        average_fill = fill;
+    }
+    // the fill level moves in frame sized steps as the emulation writes, smoothing over a few frames keeps the rate
+    // (and so the pitch) steady
+    average_fill += (fill - average_fill) * 0.02;
+    double ratio = std::max(0.25, std::min(1.25, average_fill / target));
+
+    for (int i = 0; i < count; i++)
+    {
+        while (position >= 1)
+        {
+            previous = next;
+            position -= 1;
+            if (ring.read(&next, 1) == 0)
+            {
+                // nothing left, hold the last sample until the emulation catches up
+                next = previous;
+                position = 0;
+                held.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        out[i] = (int16_t)(previous + (next - previous) * position);
+        position += ratio;
+    }
+}
+
+// little endian field of a wav header
+static void put_le(uint8_t *at, uint32_t value, int bytes)
+{
+    for (int i = 0; i < bytes; i++)
+    {
+        at[i] = (value >> (8 * i)) & 0xFF;
+    }
+}
+
+bool write_wav(const char *filename, const std::vector<int16_t> &samples, int sample_rate)
+{
+    FILE *file = fopen(filename, "wb");
+    if (file == NULL)
+    {
+        return false;
+    }
+    uint32_t data_size = samples.size() * sizeof(int16_t);
+    // the canonical 44 byte header, one fmt chunk and one data chunk
+    uint8_t header[44];
+    memcpy(header, "RIFF", 4);
+    put_le(header + 4, 36 + data_size, 4);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    put_le(header + 16, 16, 4);
+    // pcm, mono
+    put_le(header + 20, 1, 2);
+    put_le(header + 22, 1, 2);
+    put_le(header + 24, sample_rate, 4);
+    // bytes per second, bytes per sample, bits per sample
+    put_le(header + 28, sample_rate * 2, 4);
+    put_le(header + 32, 2, 2);
+    put_le(header + 34, 16, 2);
+    memcpy(header + 36, "data", 4);
+    put_le(header + 40, data_size, 4);
+    fwrite(header, 1, sizeof(header), file);
+    for (size_t i = 0; i < samples.size(); i++)
+    {
+        uint8_t bytes[2];
+        put_le(bytes, (uint16_t)samples[i], 2);
+        fwrite(bytes, 1, 2, file);
+    }
+    return fclose(file) == 0;
+}
@@ -0,0 +1,140 @@
+#ifndef audio_h
+#define audio_h
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+class chip8;
+
+/* the machine's sound, what the renderer plays between two changes
+the beeper is on while the sound timer runs, what it plays is the 128 bit pattern one bit per sample step at
+4000 * 2 ^ ((pitch - 64) / 48) steps per second, xo-chip sets both, plain chip8 keeps a 500 Hz square wave */
+struct audio_params
+{
+    bool on;
+    uint8_t pitch;
+    uint8_t pattern[16];
+};
+
+/* single producer single consumer ring buffer, lock free, neither side ever blocks or allocates
+capacity has to be a power of two, head and tail sit on their own cache lines so the two threads don't bounce one */
+template <typename T, size_t capacity>
+class spsc_queue
+{
+public:
+    spsc_queue() : head(0), tail(0) {}
+
+    // producer, copies in as many of the items as fit and returns how many that was
+    size_t write(const T *data, size_t count)
+    {
+        size_t at = head.load(std::memory_order_relaxed);
+        size_t room = capacity - (at - tail.load(std::memory_order_acquire));
+        count = count < room ? count : room;
+        for (size_t i = 0; i < count; i++)
+        {
+            items[(at + i) & (capacity - 1)] = data[i];
+        }
+        head.store(at + count, std::memory_order_release);
+        return count;
+    }
+
+    // consumer, copies out up to count items, data can be NULL to drop them instead
+    size_t read(T *data, size_t count)
+    {
+        size_t at = tail.load(std::memory_order_relaxed);
+        size_t available = head.load(std::memory_order_acquire) - at;
+        count = count < available ? count : available;
+        for (size_t i = 0; data != NULL && i < count; i++)
+        {
+            data[i] = items[(at + i) & (capacity - 1)];
+        }
+        tail.store(at + count, std::memory_order_release);
+        return count;
+    }
+
+    // either side, exact for the consumer, a lower bound for the producer
+    size_t size() const
+    {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+
+private:
+    static_assert((capacity & (capacity - 1)) == 0, "spsc_queue capacity has to be a power of two");
+
+    T items[capacity];
+    alignas(64) std::atomic<size_t> head;
+    alignas(64) std::atomic<size_t> tail;
+};
+
+/* renders the sound in emulated time, sample accurate: a change at instruction n lands on the sample that instruction
+falls on, whatever speed the emulation actually ran at
+the run loop calls update() whenever cpu.sound_flag is set (it clears the flag) and render_until() at the end of each
+frame, the samples then go to an audio_output, or to a wav file when running headless */
+class audio_renderer
+{
+public:
+    audio_renderer(int sample_rate, int cycles_per_second);
+
+    // renders up to cycle with the sound so far, then picks up the machine's current sound
+    void update(chip8 &cpu, uint64_t cycle);
+    // appends every sample up to cycle to samples
+    void render_until(uint64_t cycle);
+    // moves the render position up to cycle without producing anything, for fast-forward frames nobody will hear
+    void skip_until(uint64_t cycle);
+
+    int sample_rate() const { return rate; }
+
+    // rendered and not yet taken, the caller clears it
+    std::vector<int16_t> samples;
+
+private:
+    audio_params current;
+    int rate;
+    int cycles_per_second;
+    uint64_t rendered;
+    // position in the pattern, in bits
+    double phase;
+    double step;
+};
+
+/* plays rendered samples on the audio device's callback thread through a ring buffer
+the emulation writes a frame of samples at a time, the callback reads them through a linear interpolating resampler
+whose rate follows the ring's fill level, so small speed differences between the emulation and the device clock are
+absorbed by a slight pitch shift instead of clicks
+bigger ones are handled at the ends: the resampler speeds up to 1.25x and past that (fast-forward) the ring fills past
+max_latency and the oldest samples are dropped, in slow motion it stretches down to a quarter speed and past that holds
+the last sample, so the callback never runs dry and the sound never lags more than max_latency behind the emulation */
+class audio_output
+{
+public:
+    explicit audio_output(int sample_rate);
+
+    // emulation thread
+    void write(const int16_t *data, size_t count);
+    // audio thread, fills count samples
+    void read(int16_t *out, int count);
+
+    // how much the ring holds on average, and at most before dropping, in seconds
+    static const double target_latency;
+    static const double max_latency;
+
+    // audio thread counters, samples dropped in fast-forward and played without input in slow motion
+    std::atomic<uint64_t> dropped;
+    std::atomic<uint64_t> held;
+
+private:
+    spsc_queue<int16_t, 16384> ring;
+    int rate;
+    // the resampler sits between previous and next, position 0..1
+    double position;
+    int16_t previous;
+    int16_t next;
+    double average_fill;
+};
+
+// 16 bit mono pcm
+bool write_wav(const char *filename, const std::vector<int16_t> &samples, int sample_rate);
+
+#endif
@@ -1,4 +1,7 @@
 #include "chip8.hpp"
+#include "instrumentation.hpp"
+#include "mapped_file.hpp"
+#include "recompiler.hpp"
 #include <algorithm>
 #include <fstream>
 #include <random>
@@ -7,7 +10,9 @@
 #include <ctime>
 #include <iostream>
 
+#ifdef CHIP8_TRACE
 std::ofstream log_file;
+#endif
 
 unsigned char chip8_fontset[80] =
     {
@@ -29,12 +34,89 @@ unsigned char chip8_fontset[80] =
         0xF0, 0x80, 0xF0, 0x80, 0x80  // F
 };
 
-chip8::chip8()
+// super-chip 8x10 digits for Fx30, A-F as octo draws them
+unsigned char schip_fontset[160] =
+    {
+        0x3C, 0x7E, 0xE7, 0xC3, 0xC3, 0xC3, 0xC3, 0xE7, 0x7E, 0x3C, // 0
+        0x18, 0x38, 0x58, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x3C, // 1
+        0x3E, 0x7F, 0xC3, 0x06, 0x0C, 0x18, 0x30, 0x60, 0xFF, 0xFF, // 2
+        0x3C, 0x7E, 0xC3, 0x03, 0x0E, 0x0E, 0x03, 0xC3, 0x7E, 0x3C, // 3
+        0x06, 0x0E, 0x1E, 0x36, 0x66, 0xC6, 0xFF, 0xFF, 0x06, 0x06, // 4
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFC, 0xFE, 0x03, 0xC3, 0x7E, 0x3C, // 5
+        0x3E, 0x7C, 0xC0, 0xC0, 0xFC, 0xFE, 0xC3, 0xC3, 0x7E, 0x3C, // 6
+        0xFF, 0xFF, 0x03, 0x06, 0x0C, 0x18, 0x30, 0x60, 0x60, 0x60, // 7
+        0x3C, 0x7E, 0xC3, 0xC3, 0x7E, 0x7E, 0xC3, 0xC3, 0x7E, 0x3C, // 8
+        0x3C, 0x7E, 0xC3, 0xC3, 0x7F, 0x3F, 0x03, 0x03, 0x3E, 0x7C, // 9
+        0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+        0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, // B
+        0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, // C
+        0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  // F
+};
+const uint16_t schip_font_address = 0x50;
+
+static const quirk_profile builtin_quirks[] = {
+    // name       vf_reset shift_vy memory_increment jump_vx clip_sprites
+    {"default", false, false, true, false, true},
+    {"chip8", true, true, true, false, true},
+    {"schip", false, false, false, true, true},
+    {"xochip", false, true, true, false, false},
+    {NULL, false, false, false, false, false},
+};
+
+// hash positions, memory cells use 0x0000-0xFFFF (xo-chip has 64k), the screen and the remaining state each get their own range
+const uint32_t hash_video_base = 0x10000;
+const uint32_t hash_register_base = 0x20000;
+const uint32_t hash_stack_base = 0x20100;
+const uint32_t hash_misc_base = 0x20200;
+
+const int xochip_planes = 4;
+// what the sound timer plays until F002 loads a pattern, a square wave at 500 Hz with the default pitch
+const uint8_t default_audio_pattern = 0xF0;
+const uint8_t default_audio_pitch = 64;
+
+// fresh memory with the font loaded, built once per memory size so every instance shares the same font page
+struct initial_image
 {
+  paged_memory memory;
+  uint64_t hash;
+
+  explicit initial_image(size_t size) : memory(size), hash(0)
+  {
+    for (int i = 0; i < 80; i++)
+    {
+      memory.write(i, chip8_fontset[i]);
+      hash ^= chip8::hash_key(i, chip8_fontset[i]);
+    }
+    for (int i = 0; i < 160; i++)
+    {
+      memory.write(schip_font_address + i, schip_fontset[i]);
+      hash ^= chip8::hash_key(schip_font_address + i, schip_fontset[i]);
+    }
+  }
+};
+
+static const initial_image &get_initial_image()
+{
+  static const initial_image image(4096);
+  return image;
+}
+
+static const initial_image &get_xochip_image()
+{
+  static const initial_image image(65536);
+  return image;
+}
+
+chip8::chip8() : memory(get_initial_image().memory)
+{
+#ifdef CHIP8_TRACE
   log_file.open("chip8_instruction_log.txt");
+#endif
 
   // seed rng
-  srand(time(0));
+  seed(time(0));
 
   // set pc to 0x200, reset opode, index register, and stack pointer
   pc = 0x200;
@@ -42,32 +124,51 @@ chip8::chip8()
   I = 0;
   sp = 0;
   draw_flag = false;
+  sound_flag = false;
+  idle_flag = false;
+  fault = fault_none;
+  fault_pc = 0;
+  poll_pc = 0;
+  poll_hash = 0;
+  native_dropped = false;
+  memory_hash = get_initial_image().hash;
+  address_mask = 0x0FFF;
+  plane_mask = 1;
+  rom_end = 0x200;
+  video_hash = 0;
+  video_hash_stale = false;
+  high_resolution = false;
 
   delay_timer = 0;
   sound_timer = 0;
+  std::fill(std::begin(audio_pattern_buffer), std::end(audio_pattern_buffer), default_audio_pattern);
+  audio_pitch_register = default_audio_pitch;
 
-  // clear memory, registers, stack, display
-  std::fill(std::begin(memory), std::end(memory), 0);
+  quirks = builtin_quirks[0];
+
+  // clear registers, stack, display, memory starts as the shared font image
   std::fill(std::begin(V), std::end(V), 0);
   std::fill(std::begin(stack), std::end(stack), 0);
-  std::fill(std::begin(video), std::end(video), 0);
+  std::fill(std::begin(flag_registers), std::end(flag_registers), 0);
+  memset(video, 0, sizeof(video));
+  // no key is down until someone says so, left as it was a fresh instance read whatever the stack held
+  std::fill(std::begin(keypad), std::end(keypad), 0);
 
-  // load fonts into memory
-  for (int i = 0; i < 80; i++)
-  {
-    memory[i] = chip8_fontset[i];
-  }
+  dispatch = &get_dispatch(false);
+}
 
+chip8::dispatch_tables::dispatch_tables(bool xo)
+{
   table[0x0] = &chip8::Table0;
   table[0x1] = &chip8::op_1NNN;
   table[0x2] = &chip8::op_2NNN;
-  table[0x3] = &chip8::op_3xkk;
-  table[0x4] = &chip8::op_4xkk;
-  table[0x5] = &chip8::op_5xy0;
+  table[0x3] = &chip8::op_3xkk<false>;
+  table[0x4] = &chip8::op_4xkk<false>;
+  table[0x5] = &chip8::op_5xy0<false>;
   table[0x6] = &chip8::op_6xkk;
   table[0x7] = &chip8::op_7xkk;
   table[0x8] = &chip8::Table8;
-  table[0x9] = &chip8::op_9xy0;
+  table[0x9] = &chip8::op_9xy0<false>;
   table[0xA] = &chip8::op_Annn;
   table[0xB] = &chip8::op_Bnnn;
   table[0xC] = &chip8::op_Cxkk;
@@ -76,12 +177,22 @@ chip8::chip8()
   table[0xF] = &chip8::TableF;
 
   std::fill(std::begin(table0), std::end(table0), &chip8::op_NULL);
+  std::fill(std::begin(table5), std::end(table5), &chip8::op_5xy0<false>);
   std::fill(std::begin(table8), std::end(table8), &chip8::op_NULL);
   std::fill(std::begin(tableE), std::end(tableE), &chip8::op_NULL);
   std::fill(std::begin(tableF), std::end(tableF), &chip8::op_NULL);
 
-  table0[0x0] = &chip8::op_00E0;
-  table0[0xE] = &chip8::op_00EE;
+  table0[0xE0] = &chip8::op_00E0;
+  table0[0xEE] = &chip8::op_00EE;
+  for (int n = 0; n < 16; n++)
+  {
+    table0[0xC0 + n] = &chip8::op_00CN;
+  }
+  table0[0xFB] = &chip8::op_00FB;
+  table0[0xFC] = &chip8::op_00FC;
+  table0[0xFD] = &chip8::op_00FD;
+  table0[0xFE] = &chip8::op_00FE;
+  table0[0xFF] = &chip8::op_00FF;
 
   table8[0x0] = &chip8::op_8xy0;
   table8[0x1] = &chip8::op_8xy1;
@@ -93,8 +204,8 @@ chip8::chip8()
   table8[0x7] = &chip8::op_8xy7;
   table8[0xE] = &chip8::op_8xye;
 
-  tableE[0x1] = &chip8::op_ExA1;
-  tableE[0xE] = &chip8::op_Ex9E;
+  tableE[0x1] = &chip8::op_ExA1<false>;
+  tableE[0xE] = &chip8::op_Ex9E<false>;
 
   tableF[0x7] = &chip8::op_Fx07;
   tableF[0xA] = &chip8::op_Fx0A;
@@ -102,9 +213,443 @@ chip8::chip8()
   tableF[0x18] = &chip8::op_Fx18;
   tableF[0x1E] = &chip8::op_Fx1E;
   tableF[0x29] = &chip8::op_Fx29;
+  tableF[0x30] = &chip8::op_Fx30;
   tableF[0x33] = &chip8::op_Fx33;
   tableF[0x55] = &chip8::op_Fx55;
   tableF[0x65] = &chip8::op_Fx65;
+  tableF[0x75] = &chip8::op_Fx75;
+  tableF[0x85] = &chip8::op_Fx85;
+
+  if (!xo)
+  {
+    return;
+  }
+  // xo-chip's skips and 5xy0 step over F000 NNNN, and its new instructions get their slots
+  table[0x3] = &chip8::op_3xkk<true>;
+  table[0x4] = &chip8::op_4xkk<true>;
+  table[0x5] = &chip8::Table5;
+  table[0x9] = &chip8::op_9xy0<true>;
+  table[0xD] = &chip8::op_Dxyn_planes;
+  tableE[0x1] = &chip8::op_ExA1<true>;
+  tableE[0xE] = &chip8::op_Ex9E<true>;
+  std::fill(std::begin(table5), std::end(table5), &chip8::op_5xy0<true>);
+  table5[0x2] = &chip8::op_5xy2;
+  table5[0x3] = &chip8::op_5xy3;
+  for (int n = 0; n < 16; n++)
+  {
+    table0[0xD0 + n] = &chip8::op_00DN;
+  }
+  tableF[0x00] = &chip8::op_F000;
+  tableF[0x01] = &chip8::op_Fn01;
+  tableF[0x02] = &chip8::op_F002;
+  tableF[0x3A] = &chip8::op_Fx3A;
+}
+
+const chip8::dispatch_tables &chip8::get_dispatch(bool xo)
+{
+  static const dispatch_tables plain(false);
+  static const dispatch_tables xochip(true);
+  return xo ? xochip : plain;
+}
+
+// splitmix64 finalizer over (position, value), good enough avalanche that xoring keys together behaves like a zobrist table
+// without having to store one key per (cell, value) pair
+uint64_t chip8::hash_key(uint32_t position, uint32_t value)
+{
+  if (value == 0)
+  {
+    return 0;
+  }
+  uint64_t z = ((uint64_t)position << 32 | value) + 0x9E3779B97F4A7C15ull;
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+}
+
+// a word is two 32 bit halves at adjacent positions so it fits hash_key, an empty word still contributes nothing
+uint64_t chip8::row_key(int plane, int row, int word, uint64_t bits)
+{
+  uint32_t position = hash_video_base + ((plane * 64 + row) * 2 + word) * 2;
+  return hash_key(position, bits >> 32) ^ hash_key(position + 1, (uint32_t)bits);
+}
+
+chip8::screen_row *chip8::plane_rows(int plane)
+{
+  return plane == 0 ? video : reinterpret_cast<screen_row *>(&upper_planes[(plane - 1) * 128]);
+}
+
+const chip8::screen_row *chip8::plane_rows(int plane) const
+{
+  return plane == 0 ? video : reinterpret_cast<const screen_row *>(&upper_planes[(plane - 1) * 128]);
+}
+
+void chip8::rehash_video() const
+{
+  if (!video_hash_stale)
+  {
+    return;
+  }
+  video_hash_stale = false;
+  video_hash = 0;
+  for (int plane = 0; plane < plane_count(); plane++)
+  {
+    const screen_row *rows = plane_rows(plane);
+    for (int row = 0; row < 64; row++)
+    {
+      video_hash ^= row_key(plane, row, 0, rows[row][0]) ^ row_key(plane, row, 1, rows[row][1]);
+    }
+  }
+}
+
+void chip8::write_memory(uint16_t address, uint8_t value)
+{
+  address &= address_mask;
+  uint8_t old = memory.read(address);
+  if (old == value)
+  {
+    return;
+  }
+  memory_hash ^= hash_key(address, old) ^ hash_key(address, value);
+  memory.write(address, value);
+  if (decoded && (uint16_t)(address - decoded->begin) < decoded->handlers.size())
+  {
+    patch_decoded(address);
+  }
+  if (native)
+  {
+    uint16_t index = address - native->program->begin;
+    if (index < native->program->compiled.size() && native->program->compiled[index])
+    {
+      patch_native(address);
+    }
+  }
+}
+
+void chip8::patch_decoded(uint16_t address)
+{
+  // other instances still dispatch through this table, give this one its own before changing it
+  if (decoded.use_count() != 1)
+  {
+    decoded = std::make_shared<decode_table>(*decoded);
+  }
+  // the byte is the low half of the instruction at address - 1 and the high half of the one at address, counted with an
+  // int since at 0xFFFF a uint16_t would wrap before reaching address + 1
+  for (int offset = -1; offset <= 0; offset++)
+  {
+    uint16_t at = address + offset;
+    uint16_t index = at - decoded->begin;
+    if (index < decoded->handlers.size())
+    {
+      decoded->handlers[index] = decode(memory.read(at) << 8u | memory.read(at + 1));
+    }
+  }
+}
+
+void chip8::patch_native(uint16_t address)
+{
+  if (native.use_count() != 1)
+  {
+    native = std::make_shared<native_table>(*native);
+  }
+  // a block owns every entry into it that still points at its function, a few blocks at most contain the address
+  const native_program &program = *native->program;
+  for (size_t b = 0; b < program.blocks.size(); b++)
+  {
+    const native_program::block &block = program.blocks[b];
+    if (address < block.begin || address >= block.end)
+    {
+      continue;
+    }
+    for (uint16_t at = block.begin; at < block.end; at++)
+    {
+      chip8_native_block &entry = native->entries[at - program.begin];
+      if (entry == block.function)
+      {
+        entry = NULL;
+      }
+    }
+  }
+  native_dropped = true;
+}
+
+chip8::chip8_func chip8::decode(uint16_t op) const
+{
+  switch (op >> 12)
+  {
+  case 0x0:
+    return dispatch->table0[op & 0x00FF];
+  case 0x5:
+    return dispatch->table5[op & 0x000F];
+  case 0x8:
+    return dispatch->table8[op & 0x000F];
+  case 0xE:
+    return dispatch->tableE[op & 0x000F];
+  case 0xF:
+    return dispatch->tableF[op & 0x00FF];
+  default:
+    return dispatch->table[op >> 12];
+  }
+}
+
+void chip8::predecode()
+{
+  std::shared_ptr<decode_table> table = std::make_shared<decode_table>();
+  table->begin = 0x200;
+  table->handlers.resize(rom_end - table->begin);
+  for (size_t i = 0; i < table->handlers.size(); i++)
+  {
+    uint16_t at = table->begin + i;
+    table->handlers[i] = decode(memory.read(at) << 8u | memory.read(at + 1));
+  }
+  decoded = table;
+}
+
+void chip8::set_engine(engine_type engine)
+{
+  if (engine == engine_table)
+  {
+    decoded.reset();
+    native.reset();
+    return;
+  }
+  if (!decoded)
+  {
+    predecode();
+  }
+  if (engine == engine_predecode)
+  {
+    native.reset();
+  }
+}
+
+void chip8::set_native(std::shared_ptr<const native_program> program)
+{
+  if (!program)
+  {
+    native.reset();
+    return;
+  }
+  // whatever the blocks leave to the core runs predecoded
+  if (!decoded)
+  {
+    predecode();
+  }
+  std::shared_ptr<native_table> table = std::make_shared<native_table>();
+  table->program = program;
+  table->entries = program->entries;
+  native = table;
+}
+
+void chip8::set_platform(platform_type platform)
+{
+  bool xo = platform == platform_xochip;
+  const initial_image &image = xo ? get_xochip_image() : get_initial_image();
+  memory = image.memory;
+  memory_hash = image.hash;
+  address_mask = image.memory.size() - 1;
+  rom_end = 0x200;
+  decoded.reset();
+  native.reset();
+  upper_planes.assign(xo ? (xochip_planes - 1) * 128 : 0, 0);
+  plane_mask = 1;
+  op_00E0();
+
+  dispatch = &get_dispatch(xo);
+}
+
+chip8::platform_type chip8::platform() const
+{
+  return upper_planes.empty() ? platform_chip8 : platform_xochip;
+}
+
+const char *chip8::platform_name(int platform)
+{
+  static const char *names[platform_count] = {"chip8", "xochip"};
+  return platform >= 0 && platform < platform_count ? names[platform] : "unknown";
+}
+
+chip8::platform_type chip8::find_platform(const char *name)
+{
+  for (int i = 0; name != NULL && i < platform_count; i++)
+  {
+    if (strcmp(platform_name(i), name) == 0)
+    {
+      return (platform_type)i;
+    }
+  }
+  return platform_count;
+}
+
+chip8::engine_type chip8::engine() const
+{
+  return native ? engine_native : decoded ? engine_predecode : engine_table;
+}
+
+const char *chip8::engine_name(int engine)
+{
+  static const char *names[engine_count] = {"table", "predecode", "native"};
+  return engine >= 0 && engine < engine_count ? names[engine] : "unknown";
+}
+
+const char *chip8::fault_name(int fault)
+{
+  static const char *names[fault_count] = {"none", "unknown opcode", "stack overflow", "stack underflow", "bad address"};
+  return fault >= 0 && fault < fault_count ? names[fault] : "unknown";
+}
+
+void chip8::raise_fault(int type, uint16_t address)
+{
+  if (fault == fault_none)
+  {
+    fault = (fault_type)type;
+    fault_pc = address;
+  }
+}
+
+const quirk_profile *chip8::quirk_profiles()
+{
+  return builtin_quirks;
+}
+
+const quirk_profile *chip8::find_quirks(const char *name)
+{
+  for (const quirk_profile *profile = builtin_quirks; profile->name != NULL; profile++)
+  {
+    if (strcmp(profile->name, name) == 0)
+    {
+      return profile;
+    }
+  }
+  return NULL;
+}
+
+void chip8::set_quirks(const quirk_profile &profile)
+{
+  quirks = profile;
+}
+
+const quirk_profile &chip8::get_quirks() const
+{
+  return quirks;
+}
+
+bool chip8::share_rom(const chip8 &prototype)
+{
+  // memory size, address mask and decode tables all differ between platforms
+  if (prototype.platform() != platform())
+  {
+    return false;
+  }
+  memory = prototype.memory;
+  memory_hash = prototype.memory_hash;
+  address_mask = prototype.address_mask;
+  decoded = prototype.decoded;
+  native = prototype.native;
+  rom_end = prototype.rom_end;
+  return true;
+}
+
+// memory and screen are maintained incrementally, the handful of registers is folded in here, which is still constant time
+uint64_t chip8::state_hash() const
+{
+  rehash_video();
+  uint64_t hash = memory_hash ^ video_hash;
+  for (int i = 0; i < 16; i++)
+  {
+    hash ^= hash_key(hash_register_base + i, V[i]);
+  }
+  // only live stack entries count, stale slots above sp are never read before being overwritten
+  for (int i = 0; i < sp && i < 16; i++)
+  {
+    hash ^= hash_key(hash_stack_base + i, stack[i]);
+  }
+  hash ^= hash_key(hash_misc_base + 0, I);
+  hash ^= hash_key(hash_misc_base + 1, pc);
+  hash ^= hash_key(hash_misc_base + 2, sp);
+  hash ^= hash_key(hash_misc_base + 3, delay_timer);
+  hash ^= hash_key(hash_misc_base + 4, sound_timer);
+  hash ^= hash_key(hash_misc_base + 5, rng_state);
+  hash ^= hash_key(hash_misc_base + 6, high_resolution);
+  hash ^= hash_key(hash_misc_base + 7, plane_mask);
+  hash ^= hash_key(hash_misc_base + 8, audio_pitch_register);
+  for (int i = 0; i < 16; i++)
+  {
+    hash ^= hash_key(hash_misc_base + 0x10 + i, flag_registers[i]);
+    hash ^= hash_key(hash_misc_base + 0x20 + i, audio_pattern_buffer[i]);
+  }
+  return hash;
+}
+
+uint64_t chip8::screen_hash() const
+{
+  rehash_video();
+  return video_hash;
+}
+
+int chip8::screen_width() const
+{
+  return high_resolution ? 128 : 64;
+}
+
+int chip8::screen_height() const
+{
+  return high_resolution ? 64 : 32;
+}
+
+int chip8::plane_count() const
+{
+  return 1 + upper_planes.size() / 128;
+}
+
+int chip8::color(int x, int y) const
+{
+  int bits = pixel(x, y);
+  for (int plane = 1; plane < plane_count(); plane++)
+  {
+    bits |= ((plane_rows(plane)[y][x >> 6] >> (63 - (x & 63))) & 1) << plane;
+  }
+  return bits;
+}
+
+bool chip8::at_input_poll() const
+{
+  uint8_t high = memory.read(pc);
+  uint8_t low = memory.read(pc + 1);
+  if ((high & 0xF0) == 0xE0)
+  {
+    return low == 0x9E || low == 0xA1;
+  }
+  return (high & 0xF0) == 0xF0 && low == 0x0A;
+}
+
+void chip8::seed(uint32_t value)
+{
+  // xorshift32 has to stay away from the all zero state
+  rng_state = value ? value : 0x2545F491u;
+}
+
+chip8_registers chip8::get_registers() const
+{
+  chip8_registers registers;
+  std::copy(V, V + 16, registers.V);
+  std::copy(stack, stack + 16, registers.stack);
+  registers.I = I;
+  registers.pc = pc;
+  registers.sp = sp;
+  registers.delay_timer = delay_timer;
+  registers.sound_timer = sound_timer;
+  return registers;
+}
+
+void chip8::set_registers(const chip8_registers &registers)
+{
+  std::copy(registers.V, registers.V + 16, V);
+  std::copy(registers.stack, registers.stack + 16, stack);
+  I = registers.I;
+  pc = registers.pc;
+  sp = registers.sp & 0xF;
+  delay_timer = registers.delay_timer;
+  sound_timer = registers.sound_timer;
 }
 
 void chip8::decrement_timers()
@@ -113,32 +658,43 @@ void chip8::decrement_timers()
   {
     --delay_timer;
   }
+  if (sound_timer > 0)
+  {
+    --sound_timer;
+    if (sound_timer == 0)
+    {
+      sound_flag = true;
+    }
+  }
 }
 
 
 
 bool chip8::load_file(char const *filename)
 {
-
-  // creates an input filestream object, opens the file in binary mode, which reads the data in its binary form with translation to preserve exact format
-  // std::ios::ate (at end), sets the file pointer at the end of the file, useful to find the size of the file, since the file pointer will be at the end immediatley upon opening
-  std::ifstream file(filename, std::ios::binary | std::ios::ate);
-
-  if (!file.is_open())
+  // map the file rather than streaming it, the rom is then copied straight from the page cache into emulated memory
+  mapped_file file;
+  if (!file.open(filename))
   {
     return false;
   }
 
-  std::streampos size = file.tellg();
-  size_t memory_size = sizeof(memory) - 0x200;
-  if ((size) > memory_size)
+  return load_bytes(file.data(), file.size());
+}
+
+bool chip8::load_bytes(const uint8_t *data, size_t size)
+{
+  if (size > memory.size() - 0x200)
   {
     return false;
   }
 
-  file.seekg(0, std::ios::beg);
-  file.read((char *)memory + 0x200, size);
-  file.close();
+  // copy through write_memory so the memory hash covers the rom
+  for (size_t i = 0; i < size; i++)
+  {
+    write_memory(0x200 + i, data[i]);
+  }
+  rom_end = 0x200 + size;
 
   return true;
 }
@@ -147,58 +703,278 @@ void chip8::emulate_cycle()
 {
 
   // get the current instruction from memory, shift left 8 bits, to combine with the next half of the instruction
-  opcode = (memory[pc] << 8u | memory[pc + 1]);
+  opcode = (memory.read(pc) << 8u | memory.read(pc + 1));
+#ifdef CHIP8_TRACE
   if (log_file.is_open())
   {
     log_file << "PC: " << std::hex << pc << ", "
              << "opcode: " << opcode << std::endl;
   }
+#endif
+  CHIP8_PROFILE_CYCLE(pc, opcode);
+
+  // predecoded roms skip straight to the leaf handler, anything outside the rom (code copied into ram) decodes as usual
+  if (decoded)
+  {
+    uint16_t index = pc - decoded->begin;
+    if (index < decoded->handlers.size())
+    {
+      pc += 2;
+      ((*this).*(decoded->handlers[index]))();
+      return;
+    }
+  }
+
   pc += 2;
+
   /* get first nibble from the opcode, and use it to index into the correct tbale array
   table array contains pointers to member functions of the chip8 class,
   we use (*this).* to dereference a pointer to a member function of a class, 'this' is a pointer to the current instance of the chip8 class,
   '*' derefernces the pointer to the current instance of the class, resulting in the object itself, while the second "*" dereferences the pointer to the member function
   after dereferencing the pointer to the member function, the final set of parenthesis calls the memebr function with no args, as given by implementation*/
-  ((*this).*(table[(opcode & 0xF000) >> 12]))();
+  ((*this).*(dispatch->table[(opcode & 0xF000) >> 12]))();
 
   // decrement_timers();
 }
 
+int chip8::emulate_cycles(int count)
+{
+#ifdef CHIP8_PROFILE
+  // the counters live in emulate_cycle(), which compiled blocks skip, so a profiled build interprets every instruction
+  bool use_native = false;
+#else
+  bool use_native = (bool)native;
+#endif
+  // pointers into this instance, rebuilt per call since a copy of the machine has to point at its own registers
+  chip8_native_context context;
+  if (use_native)
+  {
+    context.V = V;
+    context.I = &I;
+    context.pc = &pc;
+    context.stack = stack;
+    context.sp = &sp;
+    context.keypad = keypad;
+    context.address_mask = address_mask;
+    context.vf_reset = quirks.vf_reset;
+    context.shift_vy = quirks.shift_vy;
+    context.interpret = &chip8::interpret_native;
+    context.machine = this;
+  }
+  int done = 0;
+  while (done < count)
+  {
+    if (use_native)
+    {
+      uint16_t index = pc - native->program->begin;
+      if (index < native->entries.size() && native->entries[index] != NULL)
+      {
+        context.stop = 0;
+        done += native->entries[index](&context, count - done);
+        if (context.stop)
+        {
+          return done;
+        }
+        continue;
+      }
+    }
+    // anything no block covers, code outside the rom, code a write dropped, or the rest of a block a budget cut short
+    bool sound = sound_flag;
+    bool idle = idle_flag;
+    emulate_cycle();
+    done++;
+    if ((sound_flag && !sound) || (idle_flag && !idle))
+    {
+      return done;
+    }
+  }
+  return done;
+}
+
+void chip8::interpret_native(chip8_native_context *context)
+{
+  chip8 &cpu = *static_cast<chip8 *>(context->machine);
+  bool sound = cpu.sound_flag;
+  bool idle = cpu.idle_flag;
+  cpu.native_dropped = false;
+  cpu.emulate_cycle();
+  context->stop = (cpu.sound_flag && !sound) || (cpu.idle_flag && !idle) || cpu.native_dropped;
+}
+
 void chip8::Table0()
 {
-  ((*this).*(table0[opcode & 0x000F]))();
+  ((*this).*(dispatch->table0[opcode & 0x00FF]))();
+}
+
+void chip8::Table5()
+{
+  ((*this).*(dispatch->table5[opcode & 0x000F]))();
 }
 
 void chip8::Table8()
 {
-  ((*this).*(table8[opcode & 0x000F]))();
+  ((*this).*(dispatch->table8[opcode & 0x000F]))();
 }
 
 void chip8::TableE()
 {
-  ((*this).*(tableE[opcode & 0x000F]))();
+  ((*this).*(dispatch->tableE[opcode & 0x000F]))();
 }
 
 void chip8::TableF()
 {
-  ((*this).*(tableF[opcode & 0x00FF]))();
+  ((*this).*(dispatch->tableF[opcode & 0x00FF]))();
 }
 
 // clear the display
 void chip8::op_00E0()
 {
-  for (int i = 0; i < 2048; i++)
+  clear_planes(plane_mask);
+}
+
+// the scrolls and clears only touch the selected planes, which outside xo-chip is always just plane 0
+void chip8::clear_planes(int mask)
+{
+  if (plane_count() == 1)
+  {
+    memset(video, 0, sizeof(video));
+    video_hash = 0;
+    video_hash_stale = false;
+  }
+  else
+  {
+    for (int plane = 0; plane < plane_count(); plane++)
+    {
+      if (mask >> plane & 1)
+      {
+        memset(plane_rows(plane), 0, sizeof(video));
+      }
+    }
+    video_hash_stale = true;
+  }
+  draw_flag = true;
+}
+
+// scd n - scroll the display down n rows, in low resolution the rows are low resolution rows
+void chip8::op_00CN()
+{
+  int n = opcode & 0x000F;
+  int rows = screen_height();
+  for (int plane = 0; plane < plane_count(); plane++)
+  {
+    if (plane_mask >> plane & 1)
+    {
+      screen_row *screen = plane_rows(plane);
+      memmove(screen[n], screen[0], (rows - n) * sizeof(screen_row));
+      memset(screen[0], 0, n * sizeof(screen_row));
+    }
+  }
+  video_hash_stale = true;
+  draw_flag = true;
+}
+
+// scu n - xo-chip, scroll the display up n rows
+void chip8::op_00DN()
+{
+  int n = opcode & 0x000F;
+  int rows = screen_height();
+  for (int plane = 0; plane < plane_count(); plane++)
+  {
+    if (plane_mask >> plane & 1)
+    {
+      screen_row *screen = plane_rows(plane);
+      memmove(screen[0], screen[n], (rows - n) * sizeof(screen_row));
+      memset(screen[rows - n], 0, n * sizeof(screen_row));
+    }
+  }
+  video_hash_stale = true;
+  draw_flag = true;
+}
+
+// scr - scroll the display right 4 pixels, one shift per word with the bits crossing between the two halves carried over
+void chip8::op_00FB()
+{
+  int rows = screen_height();
+  for (int plane = 0; plane < plane_count(); plane++)
+  {
+    if (!(plane_mask >> plane & 1))
+    {
+      continue;
+    }
+    screen_row *screen = plane_rows(plane);
+    for (int y = 0; y < rows; y++)
+    {
+      if (high_resolution)
+      {
+        screen[y][1] = screen[y][1] >> 4 | screen[y][0] << 60;
+      }
+      screen[y][0] >>= 4;
+    }
+  }
+  video_hash_stale = true;
+  draw_flag = true;
+}
+
+// scl - scroll the display left 4 pixels
+void chip8::op_00FC()
+{
+  int rows = screen_height();
+  for (int plane = 0; plane < plane_count(); plane++)
   {
-    video[i] = 0;
+    if (!(plane_mask >> plane & 1))
+    {
+      continue;
+    }
+    screen_row *screen = plane_rows(plane);
+    for (int y = 0; y < rows; y++)
+    {
+      screen[y][0] <<= 4;
+      if (high_resolution)
+      {
+        screen[y][0] |= screen[y][1] >> 60;
+        screen[y][1] <<= 4;
+      }
+    }
   }
+  video_hash_stale = true;
   draw_flag = true;
 }
 
+// exit - stop the interpreter, modelled as spinning on this instruction so the machine state stays put
+void chip8::op_00FD()
+{
+  pc -= 2;
+  idle_flag = true;
+}
+
+// low - back to 64x32, every plane is cleared like octo does on a resolution switch
+void chip8::op_00FE()
+{
+  high_resolution = false;
+  clear_planes(0xF);
+}
+
+// high - 128x64 mode
+void chip8::op_00FF()
+{
+  high_resolution = true;
+  clear_planes(0xF);
+}
+
 // return from subroutine
 // set the pc to address at top of stack, subtract 1 from sp
 void chip8::op_00EE()
 {
-  --sp;
+  if (sp == 0)
+  {
+    raise_fault(fault_stack_underflow, pc - 2);
+  }
+  // sp wraps within the 16 entries, a rom that returns too often or nests too deep must not write outside the stack
+  sp = (sp - 1) & 0xF;
+  if (stack[sp] < 0x200 || stack[sp] > address_mask)
+  {
+    raise_fault(fault_bad_address, pc - 2);
+  }
   pc = stack[sp];
 }
 
@@ -206,52 +982,104 @@ void chip8::op_00EE()
 void chip8::op_1NNN()
 {
   uint16_t address = opcode & 0x0FFF;
+  if (address == pc - 2)
+  {
+    idle_flag = true;
+  }
+  else if (address < 0x200)
+  {
+    raise_fault(fault_bad_address, pc - 2);
+  }
   pc = address;
 }
 
 // call subroutine at nnn, increments the stack pointer, puts current pc on top of stack, then sets pc to nnnn
 void chip8::op_2NNN()
 {
-
-  stack[sp] = pc;
-  ++sp;
   uint16_t address = opcode & 0x0FFF;
+  if (sp == 15 || address < 0x200)
+  {
+    raise_fault(sp == 15 ? fault_stack_overflow : fault_bad_address, pc - 2);
+  }
+  stack[sp] = pc;
+  sp = (sp + 1) & 0xF;
   pc = address;
 }
 
+// every skip goes through here, xo-chip's F000 NNNN is four bytes long and has to be skipped whole
+template <bool xo>
+inline void chip8::skip_next()
+{
+  if (xo && memory.read(pc) == 0xF0 && memory.read(pc + 1) == 0x00)
+  {
+    pc += 2;
+  }
+  pc += 2;
+}
+
 // skips next instruction if Vx = kk, compares register Vx to kk, if equal, increment pc by 2 to skip next instruction
+template <bool xo>
 void chip8::op_3xkk()
 {
   uint8_t vx = (opcode & 0x0F00) >> 8;
   uint8_t kk = opcode & 0x00FF;
 
+  CHIP8_PROFILE_SKIP(skip_3xkk, V[vx] == kk);
   if (V[vx] == kk)
   {
-    pc += 2;
+    skip_next<xo>();
   }
 }
 
 // skips next instruction if Vx != kk
+template <bool xo>
 void chip8::op_4xkk()
 {
   uint8_t vx = (opcode & 0x0F00) >> 8;
   uint8_t kk = opcode & 0x00FF;
 
+  CHIP8_PROFILE_SKIP(skip_4xkk, V[vx] != kk);
   if (V[vx] != kk)
   {
-    pc += 2;
+    skip_next<xo>();
   }
 }
 
 // skips next instruction if registed Vx == Vy
+template <bool xo>
 void chip8::op_5xy0()
 {
   uint8_t vx = (opcode & 0x0F00) >> 8;
   uint8_t vy = (opcode & 0x00F0) >> 4;
 
+  CHIP8_PROFILE_SKIP(skip_5xy0, V[vx] == V[vy]);
   if (V[vx] == V[vy])
   {
-    pc += 2;
+    skip_next<xo>();
+  }
+}
+
+// save vx - vy, xo-chip, stores the registers from vx to vy (in either direction) at I, I is left alone
+void chip8::op_5xy2()
+{
+  int vx = (opcode & 0x0F00) >> 8;
+  int vy = (opcode & 0x00F0) >> 4;
+  int step = vx <= vy ? 1 : -1;
+  for (int i = 0; i <= abs(vy - vx); i++)
+  {
+    write_memory(I + i, V[vx + i * step]);
+  }
+}
+
+// load vx - vy, xo-chip, the reverse of 5xy2
+void chip8::op_5xy3()
+{
+  int vx = (opcode & 0x0F00) >> 8;
+  int vy = (opcode & 0x00F0) >> 4;
+  int step = vx <= vy ? 1 : -1;
+  for (int i = 0; i <= abs(vy - vx); i++)
+  {
+    V[vx + i * step] = memory.read(I + i);
   }
 }
 
@@ -289,6 +1117,10 @@ void chip8::op_8xy1()
   uint8_t vy = (opcode & 0x00F0) >> 4;
 
   V[vx] |= V[vy];
+  if (quirks.vf_reset)
+  {
+    V[0xF] = 0;
+  }
 }
 
 // and vx, vy - stores value of bitwise AND vx, vy in register vx
@@ -298,6 +1130,10 @@ void chip8::op_8xy2()
   uint8_t vy = (opcode & 0x00F0) >> 4;
 
   V[vx] &= V[vy];
+  if (quirks.vf_reset)
+  {
+    V[0xF] = 0;
+  }
 }
 
 // xor vx, vy - stores value of bitwise XOR vx, vy, in register vx
@@ -307,6 +1143,10 @@ void chip8::op_8xy3()
   uint8_t vy = (opcode & 0x00F0) >> 4;
 
   V[vx] ^= V[vy];
+  if (quirks.vf_reset)
+  {
+    V[0xF] = 0;
+  }
 }
 
 // add vx, vy - set vx = vx + vy, set vf = carry, the values of vx and vy are added together, if result is greater than 8 bits, VF is set to 1, otherwise 0
@@ -351,6 +1191,10 @@ void chip8::op_8xy5()
 void chip8::op_8xy6()
 {
   uint8_t vx = (opcode & 0x0F00) >> 8;
+  if (quirks.shift_vy)
+  {
+    V[vx] = V[(opcode & 0x00F0) >> 4];
+  }
   uint8_t temp;
   if ((V[vx] & 0x1) == 1)
   {
@@ -387,19 +1231,25 @@ void chip8::op_8xy7()
 void chip8::op_8xye()
 {
   uint8_t vx = (opcode & 0x0F00) >> 8;
+  if (quirks.shift_vy)
+  {
+    V[vx] = V[(opcode & 0x00F0) >> 4];
+  }
   uint8_t temp = (V[vx] & 0x80) >> 7;
   V[vx] <<= 1;
   V[0xF] = temp;
 }
 
 // sne vx, vy - skip next instruction if vx != vy
+template <bool xo>
 void chip8::op_9xy0()
 {
   uint8_t vx = (opcode & 0x0F00) >> 8;
   uint8_t vy = (opcode & 0x00F0) >> 4;
+  CHIP8_PROFILE_SKIP(skip_9xy0, V[vx] != V[vy]);
   if (V[vx] != V[vy])
   {
-    pc += 2;
+    skip_next<xo>();
   }
 }
 
@@ -414,52 +1264,177 @@ void chip8::op_Annn()
 void chip8::op_Bnnn()
 {
   uint16_t address = opcode & 0x0FFF;
-  pc = address + V[0x0];
+  address += V[quirks.jump_vx ? (opcode & 0x0F00) >> 8 : 0x0];
+  if (address < 0x200 || address > address_mask)
+  {
+    raise_fault(fault_bad_address, pc - 2);
+  }
+  pc = address;
 }
 
 // rnd vx, byte - generate a random number from 0-255, AND with value kk, and store in register vx
 void chip8::op_Cxkk()
 {
-  uint8_t random_number = static_cast<unsigned short>(rand() % 256);
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 17;
+  rng_state ^= rng_state << 5;
+  uint8_t random_number = static_cast<uint8_t>(rng_state >> 24);
   uint8_t kk = opcode & 0x00FF;
   uint8_t vx = (opcode & 0x0F00) >> 8;
   V[vx] = kk & random_number;
 }
 
+// the sprite row arrives left aligned in a word, it is split across the two screen words and whatever runs off the right
+// edge either wraps to the left or is dropped
+inline bool chip8::draw_row(int plane, int y, int x, uint64_t bits)
+{
+  uint64_t left, right, spill;
+  if (x < 64)
+  {
+    left = bits >> x;
+    right = x ? bits << (64 - x) : 0;
+    spill = 0;
+  }
+  else
+  {
+    left = 0;
+    right = bits >> (x - 64);
+    spill = x > 64 ? bits << (128 - x) : 0;
+  }
+  if (!high_resolution)
+  {
+    // in low resolution the screen ends after the first word
+    spill = right;
+    right = 0;
+  }
+  if (!quirks.clip_sprites)
+  {
+    left |= spill;
+  }
+
+  uint64_t *line = plane_rows(plane)[y];
+  bool erased = ((line[0] & left) | (line[1] & right)) != 0;
+  // a changed word swaps its key in the screen hash, harmless while the hash is stale since it gets recomputed anyway
+  if (left)
+  {
+    video_hash ^= row_key(plane, y, 0, line[0]);
+    line[0] ^= left;
+    video_hash ^= row_key(plane, y, 0, line[0]);
+  }
+  if (right)
+  {
+    video_hash ^= row_key(plane, y, 1, line[1]);
+    line[1] ^= right;
+    video_hash ^= row_key(plane, y, 1, line[1]);
+  }
+  return erased;
+}
+
 // drw vx, vy, nibble - display n byte sprite starting at memory location I at (Vx, vy), set vf = collision
 /* the interpreter reads n bytes from memory, starting at the address sotres in I, these bytes are then displayed as sptires on screen at coordinates (vx, vy)
 the sprites are XORed onto the existing screen, if this causes any pixels to be erased, vf is set to 1, otherwise 0, if the sprite is positioned to part of it
 is outisde the coordinates of the display, it wraps around to the opposide side of the screen
-width of 8 pixels, and height of N pixels, */
+width of 8 pixels, and height of N pixels, Dxy0 draws a super-chip 16x16 sprite from 32 bytes, two per row
+each sprite row is shifted into place as a mask over the two words of the screen row and xored in, so a row costs the
+same however many of its pixels are set */
 void chip8::op_Dxyn()
 {
   uint8_t vx = (opcode & 0x0F00) >> 8;
   uint8_t vy = (opcode & 0x00F0) >> 4;
-  uint8_t byte = opcode & 0x000F;
+  int height = opcode & 0x000F;
+  int sprite_bytes = 1;
+  if (height == 0)
+  {
+    height = 16;
+    sprite_bytes = 2;
+  }
 
-  uint8_t x_pos = V[vx] % 64;
-  uint8_t y_pos = V[vy] % 32;
+  int rows = screen_height();
+  int x_pos = V[vx] & (screen_width() - 1);
+  int y_pos = V[vy] & (rows - 1);
 
   V[0xF] = 0;
 
-  for (uint8_t row = 0; row < byte; row++)
+  uint16_t address = I;
+  for (int row = 0; row < height; row++)
+  {
+    // rows past the bottom edge are dropped or wrapped depending on the quirk profile
+    int y = y_pos + row;
+    if (y >= rows)
+    {
+      if (quirks.clip_sprites)
+      {
+        break;
+      }
+      y -= rows;
+    }
+    uint64_t bits = (uint64_t)memory.read(address) << 56;
+    if (sprite_bytes == 2)
+    {
+      bits |= (uint64_t)memory.read(address + 1) << 48;
+    }
+    address += sprite_bytes;
+    if (draw_row(0, y, x_pos, bits))
+    {
+      V[0xF] = 1;
+    }
+  }
+  draw_flag = true;
+}
+
+// xo-chip drw, the same sprite format drawn into every plane Fn01 selected, the planes take consecutive sprites from I
+// (plane 0's rows, then plane 1's, ...), all planes are done row by row in the one pass over the sprite
+void chip8::op_Dxyn_planes()
+{
+  uint8_t vx = (opcode & 0x0F00) >> 8;
+  uint8_t vy = (opcode & 0x00F0) >> 4;
+  int height = opcode & 0x000F;
+  int sprite_bytes = 1;
+  if (height == 0)
+  {
+    height = 16;
+    sprite_bytes = 2;
+  }
+
+  int rows = screen_height();
+  int x_pos = V[vx] & (screen_width() - 1);
+  int y_pos = V[vy] & (rows - 1);
+  int sprite_size = height * sprite_bytes;
+
+  int planes[xochip_planes];
+  int selected = 0;
+  for (int plane = 0; plane < plane_count(); plane++)
   {
-    uint8_t sprite_byte = memory[I + row];
-    for (uint8_t col = 0; col < 8; col++)
+    if (plane_mask >> plane & 1)
     {
-      // checks each byte in the sprite to see whether it is on, shift by col from 0 - 8 as they are stored left to right, and we want to check every col
+      planes[selected++] = plane;
+    }
+  }
 
-      uint8_t sprite_pixel = sprite_byte & (0x80u >> col);
-      // stores address of the screen pixel to be drawn, multiply
-      uint32_t *screen_pixel = &video[(y_pos + row) * 64 + (x_pos + col)];
+  V[0xF] = 0;
 
-      if (sprite_pixel)
+  for (int row = 0; row < height; row++)
+  {
+    int y = y_pos + row;
+    if (y >= rows)
+    {
+      if (quirks.clip_sprites)
       {
-        if (*screen_pixel == 1)
-        {
-          V[0xF] = 1;
-        }
-        *screen_pixel ^= 1;
+        break;
+      }
+      y -= rows;
+    }
+    for (int i = 0; i < selected; i++)
+    {
+      uint16_t address = I + i * sprite_size + row * sprite_bytes;
+      uint64_t bits = (uint64_t)memory.read(address) << 56;
+      if (sprite_bytes == 2)
+      {
+        bits |= (uint64_t)memory.read(address + 1) << 48;
+      }
+      if (draw_row(planes[i], y, x_pos, bits))
+      {
+        V[0xF] = 1;
       }
     }
   }
@@ -467,30 +1442,77 @@ void chip8::op_Dxyn()
 }
 
 // skp vx - skips next instruction if key with the value of vx is pressed
+template <bool xo>
 void chip8::op_Ex9E()
 {
   uint8_t vx = (opcode & 0x0F00) >> 8;
+  CHIP8_PROFILE_SKIP(skip_Ex9E, keypad[V[vx] & 0xF]);
   if (keypad[V[vx] & 0xF])
   {
-    pc += 2;
+    skip_next<xo>();
   }
 }
 
 // sknp vx - skips next instrucion if key with value of vx is not pressed
+template <bool xo>
 void chip8::op_ExA1()
 {
   uint8_t vx = (opcode & 0x0F00) >> 8;
+  CHIP8_PROFILE_SKIP(skip_ExA1, !keypad[V[vx] & 0xF]);
   if (!keypad[V[vx] & 0xF])
   {
-    pc += 2;
+    skip_next<xo>();
   }
 }
 
+// ld i, long nnnn - xo-chip, I is loaded from the word after the instruction, which is then stepped over
+void chip8::op_F000()
+{
+  I = memory.read(pc) << 8 | memory.read(pc + 1);
+  pc += 2;
+}
+
+// plane n - xo-chip, selects the bitplanes later draws, scrolls and clears work on
+void chip8::op_Fn01()
+{
+  plane_mask = (opcode & 0x0F00) >> 8;
+}
+
+// audio - xo-chip, the 16 bytes at I become the 1-bit sample pattern the sound timer plays
+void chip8::op_F002()
+{
+  for (int i = 0; i < 16; i++)
+  {
+    audio_pattern_buffer[i] = memory.read((I + i) & address_mask);
+  }
+  sound_flag = true;
+}
+
+// pitch vx - xo-chip, the pattern plays at 4000 * 2 ^ ((vx - 64) / 48) bits per second
+void chip8::op_Fx3A()
+{
+  uint8_t vx = (opcode & 0x0F00) >> 8;
+  audio_pitch_register = V[vx];
+  sound_flag = true;
+}
+
 // ld vx, dt - value of delay timer is placed into vx
 void chip8::op_Fx07()
 {
   uint8_t vx = (opcode & 0x0F00) >> 8;
   V[vx] = delay_timer;
+  // a wait loop polls the timer over and over, once a poll finds the machine exactly as the last one left it the loop
+  // can only go round again until the timer moves, the full state hash is what makes that exact and only costs here
+  if (delay_timer > 0)
+  {
+    uint64_t hash = state_hash();
+    if (pc == poll_pc && hash == poll_hash)
+    {
+      idle_flag = true;
+    }
+    poll_pc = pc;
+    poll_hash = hash;
+  }
 }
 
 // ld vx, k - wait for a key press store the value of key in vx, all execution stops until a key is pressed, then the value of that key is stored in vx
@@ -509,6 +1531,7 @@ void chip8::op_Fx0A()
   if (!key_press)
   {
     pc -= 2; // decrement pc to repeat this instruction until a key is pressed
+    idle_flag = true;
   }
 }
 
@@ -524,6 +1547,7 @@ void chip8::op_Fx18()
 {
   uint8_t vx = (opcode & 0x0F00) >> 8;
   sound_timer = V[vx];
+  sound_flag = true;
 }
 
 // add i, vx - values of I and vx are added and stored in I
@@ -536,8 +1560,15 @@ void chip8::op_Fx1E()
 // ld f, vx - value of I is set to the location for the hexadeciaml sprite corresponding to the value of vx
 void chip8::op_Fx29()
 {
-  uint8_t vx = opcode & 0x0F00 >> 8;
-  I = memory[(V[vx] * 5) & 0xF];
+  uint8_t vx = (opcode & 0x0F00) >> 8;
+  I = (V[vx] & 0xF) * 5;
+}
+
+// ld hf, vx - I is set to the super-chip 8x10 sprite for the digit in vx
+void chip8::op_Fx30()
+{
+  uint8_t vx = (opcode & 0x0F00) >> 8;
+  I = schip_font_address + (V[vx] & 0xF) * 10;
 }
 
 // ld b, vx - interpreter takes decimal vaue of vx, places 100's digit at memory location I, 10's digit at I + 1, 1's digit at I + 2
@@ -545,13 +1576,13 @@ void chip8::op_Fx33() {
   uint8_t vx = (opcode & 0x0F00) >> 8;
   uint8_t value = V[vx];
 
-  memory[I + 2] = value % 10;
+  write_memory(I + 2, value % 10);
   value /= 10;
 
-  memory[I + 1] = value % 10;
+  write_memory(I + 1, value % 10);
   value /= 10;
 
-  memory[I] = value % 10;
+  write_memory(I, value % 10);
 }
 
 
@@ -561,7 +1592,11 @@ void chip8::op_Fx55()
   uint8_t vx = (opcode & 0x0F00) >> 8;
   for (int i = 0; i <= vx; i++)
   {
-    memory[I++] = V[i];
+    write_memory(I + i, V[i]);
+  }
+  if (quirks.memory_increment)
+  {
+    I += vx + 1;
   }
 }
 
@@ -571,8 +1606,35 @@ void chip8::op_Fx65()
   uint8_t vx = (opcode & 0x0F00) >> 8;
   for (int i = 0; i <= vx; i++)
   {
-    V[i] = memory[I++];
+    V[i] = memory.read(I + i);
+  }
+  if (quirks.memory_increment)
+  {
+    I += vx + 1;
+  }
+}
+
+// ld r, vx - stores v0-vx in the flag registers, super-chip only has 8 of them, xo-chip allows all 16
+void chip8::op_Fx75()
+{
+  uint8_t vx = (opcode & 0x0F00) >> 8;
+  for (int i = 0; i <= vx; i++)
+  {
+    flag_registers[i] = V[i];
+  }
+}
+
+// ld vx, r - reads v0-vx back from the flag registers
+void chip8::op_Fx85()
+{
+  uint8_t vx = (opcode & 0x0F00) >> 8;
+  for (int i = 0; i <= vx; i++)
+  {
+    V[i] = flag_registers[i];
   }
 }
 
-void chip8::op_NULL() {}
+void chip8::op_NULL()
+{
+  raise_fault(fault_unknown_opcode, pc - 2);
+}
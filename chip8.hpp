@@ -3,13 +3,54 @@
 
 #include <cstdlib>
 #include <ctime> 
+#include <memory>
 #include <stdint.h>
+#include <vector>
+#include "paged_memory.hpp"
+
+// see recompiler.hpp
+class native_program;
+struct chip8_native_context;
+typedef int (*chip8_native_block)(chip8_native_context *context, int budget);
+
+/* behaviours that differ between chip8 interpreters, roms written for one platform often misbehave on another
+default is what this emulator has always done */
+struct quirk_profile
+{
+    const char *name;
+    // 8xy1/8xy2/8xy3 reset vf to 0 (cosmac vip)
+    bool vf_reset;
+    // 8xy6/8xyE shift vy into vx instead of shifting vx in place
+    bool shift_vy;
+    // Fx55/Fx65 leave I pointing past the last register
+    bool memory_increment;
+    // Bnnn jumps to xnn + vx instead of nnn + v0 (super-chip)
+    bool jump_vx;
+    // sprites are cut off at the screen edges instead of wrapping around
+    bool clip_sprites;
+};
+
+// the cpu side of the machine state, what tools read and write when they need more than a hash
+struct chip8_registers
+{
+    uint8_t V[16];
+    uint16_t I;
+    uint16_t pc;
+    uint16_t stack[16];
+    uint8_t sp;
+    uint8_t delay_timer;
+    uint8_t sound_timer;
+};
 
 class chip8
 {
+public:
+    // one framebuffer row, 128 pixels packed msb first, see video
+    typedef uint64_t screen_row[2];
+
 private:
-    // memory size of 4k, char is 1 byte
-    uint8_t memory[4096];
+    // memory size of 4k (64k on xo-chip), stored as copy on write pages so copies of a chip8 share everything they have not written
+    paged_memory memory;
     // current opcode, size of each opcode is 2 bytes
     uint16_t opcode;
     // registers v0-vf, each register is 8 bits
@@ -27,25 +68,73 @@ private:
     uint16_t stack[16];
     // stack pointer
     uint8_t sp;
+    quirk_profile quirks;
+    // xorshift state behind op_Cxkk, kept per instance so runs replay exactly and threads don't share rand()
+    uint32_t rng_state;
+    // super-chip 128x64 mode, switched by 00FF/00FE
+    bool high_resolution;
+    // super-chip persistent flag registers (the hp48 rpl flags) behind Fx75/Fx85
+    uint8_t flag_registers[16];
+    // xo-chip bitplanes 1-3, empty on every other platform so plain instances stay small to copy, plane 0 is video
+    std::vector<uint64_t> upper_planes;
+    // the planes Fn01 selected for drawing, scrolling and clearing, always 1 outside xo-chip
+    uint8_t plane_mask;
+    // xo-chip audio, the 128 bit pattern F002 loads and the pitch Fx3A sets, plain chip8 keeps the default square wave
+    uint8_t audio_pattern_buffer[16];
+    uint8_t audio_pitch_register;
+    // 0x0FFF, or 0xFFFF on xo-chip, kept down here so I and pc stay where they were, a store to I next to the pc load
+    // every cycle does stalls the loop
+    uint16_t address_mask;
+    // where and in what state Fx07 last found the delay timer running this frame, see idle_flag
+    uint16_t poll_pc;
+    uint64_t poll_hash;
+    // set by patch_native(), tells a running native block that it may have just rewritten itself
+    bool native_dropped;
 
     //const int mem_start = 0x200;
 
+    // incremental hashes of memory and the framebuffer, each is the XOR of hash_key(position, value) over every non-zero cell
+    // kept up to date by write_memory() and op_Dxyn/op_00E0 so state_hash() never has to walk the 4k of memory or the screen
+    uint64_t memory_hash;
+    // scrolls move every row at once, they only mark the screen hash stale and the next read recomputes it
+    mutable uint64_t video_hash;
+    mutable bool video_hash_stale;
+
     /* memory map:
     0x000-0x1FF - chip 8 interpreter/font set
-    0x050-0x0A0 - used for the built in 4x5 pixel font set (0-F)
+    0x000-0x04F - used for the built in 4x5 pixel font set (0-F)
+    0x050-0x0EF - super-chip 8x10 font (0-F) for Fx30
     0x200-0xFFF - program ROM and work RAM
     */
 
+    // every store into memory goes through here so memory_hash stays in sync
+    void write_memory(uint16_t address, uint8_t value);
+    // hash contribution of one framebuffer word, see video
+    static uint64_t row_key(int plane, int row, int word, uint64_t bits);
+    screen_row *plane_rows(int plane);
+    const screen_row *plane_rows(int plane) const;
+    // xors one sprite row (left aligned in bits) into a plane at x, returns true if it erased a pixel
+    bool draw_row(int plane, int y, int x, uint64_t bits);
+    void clear_planes(int mask);
+    // recomputes video_hash from scratch if a scroll left it stale
+    void rehash_video() const;
+
+    // records a fault unless an earlier one is still pending, address is the instruction that caused it
+    void raise_fault(int type, uint16_t address);
+
     void op_NULL();
 
+    // skips step over the four byte F000 NNNN on xo-chip, the plain versions don't pay for the check
+    template <bool xo> void skip_next();
+
     void op_1NNN();
     void op_2NNN();
-    void op_3xkk();
-    void op_4xkk();
-    void op_5xy0();
+    template <bool xo> void op_3xkk();
+    template <bool xo> void op_4xkk();
+    template <bool xo> void op_5xy0();
     void op_6xkk();
     void op_7xkk();
-    void op_9xy0();
+    template <bool xo> void op_9xy0();
     void op_Annn();
     void op_Bnnn();
     void op_Cxkk();
@@ -63,9 +152,25 @@ private:
 
     void op_00EE();
     void op_00E0();
+    void op_00CN();
+    void op_00FB();
+    void op_00FC();
+    void op_00FD();
+    void op_00FE();
+    void op_00FF();
+
+    // xo-chip
+    void op_00DN();
+    void op_5xy2();
+    void op_5xy3();
+    void op_Dxyn_planes();
+    void op_F000();
+    void op_Fn01();
+    void op_F002();
+    void op_Fx3A();
 
-    void op_Ex9E();
-    void op_ExA1();
+    template <bool xo> void op_Ex9E();
+    template <bool xo> void op_ExA1();
 
     void op_Fx07();
     void op_Fx0A();
@@ -73,10 +178,14 @@ private:
     void op_Fx18();
     void op_Fx1E();
     void op_Fx29();
+    void op_Fx30();
     void op_Fx33();
     void op_Fx55();
     void op_Fx65();
+    void op_Fx75();
+    void op_Fx85();
     void Table0();
+    void Table5();
     void Table8();
     void TableE();
     void TableF();
@@ -84,11 +193,54 @@ private:
     // using chip8_func = void (chip8::*)();
     typedef void (chip8::*chip8_func)();
 
-    chip8_func table[0xF + 1];
-    chip8_func table0[0xE + 1];
-    chip8_func table8[0xE + 1];
-    chip8_func tableE[0xE + 1];
-    chip8_func tableF[0x65 + 1];
+    // the dispatch tables only depend on the platform, so there is one set per platform, built on first use and shared
+    // by every instance, a copy of the machine copies the pointer rather than ~10 KB of member function pointers
+    struct dispatch_tables
+    {
+        chip8_func table[0xF + 1];
+        // sized for every value of the nibble or byte that indexes them, unused slots hold op_NULL
+        // table0 goes by the low byte so the super-chip 00Cn/00Fx instructions get their own slots
+        chip8_func table0[0xFF + 1];
+        // only dispatched through on xo-chip, where 5xy2/5xy3 exist, elsewhere every entry is op_5xy0 as before
+        chip8_func table5[0xF + 1];
+        chip8_func table8[0xF + 1];
+        chip8_func tableE[0xF + 1];
+        chip8_func tableF[0xFF + 1];
+
+        explicit dispatch_tables(bool xo);
+    };
+    static const dispatch_tables &get_dispatch(bool xo);
+    const dispatch_tables *dispatch;
+
+    // one past the last byte of the loaded rom, can be 0x10000 on xo-chip
+    uint32_t rom_end;
+
+    // predecoded handlers for the rom's address range, one entry per byte address so odd pcs work too
+    // built once per rom and shared between every instance running it, an instance takes a private copy the first time it
+    // writes into the range (self modifying code) and re-decodes just the two entries the write touched
+    struct decode_table
+    {
+        uint16_t begin;
+        std::vector<chip8_func> handlers;
+    };
+    std::shared_ptr<decode_table> decoded;
+
+    // resolves an opcode down to its leaf handler, skipping the Table0/8/E/F second level
+    chip8_func decode(uint16_t op) const;
+    void patch_decoded(uint16_t address);
+
+    // the entry points of a native_program, shared and copied on write the same way as decoded, a write into code a
+    // block was compiled from drops every entry into that block and predecode runs it from then on
+    struct native_table
+    {
+        std::shared_ptr<const native_program> program;
+        std::vector<chip8_native_block> entries;
+    };
+    std::shared_ptr<native_table> native;
+
+    void patch_native(uint16_t address);
+    // the callback native blocks hand instructions they don't translate to
+    static void interpret_native(chip8_native_context *context);
 
     /*nnn or addr - A 12-bit value, the lowest 12 bits of the instruction
     n or nibble - A 4-bit value, the lowest 4 bits of the instruction
@@ -105,17 +257,131 @@ private:
     // further, we can extract the lowest bits by taking Fx07 & 0x000Fu, resulting in 0x7
 
 public:
-    // video screen
-    uint32_t video[62 * 34];
+    /* framebuffer, 64 rows of 128 pixels packed msb first: video[y][0] holds x 0-63 with x 0 in the top bit, video[y][1]
+    holds x 64-127, so a sprite row is a shift and an xor and the super-chip scrolls are word shifts and memmoves
+    in low resolution only the top left 64x32 is used, everything else stays zero
+    this is bitplane 0, xo-chip's other planes are reached through color() */
+    screen_row video[64];
     unsigned short keypad[16]; 
     bool draw_flag; 
+    // set when the beeper turns on or off or its pattern or pitch changes, cleared by whoever plays the sound
+    bool sound_flag;
+    /* set when the rom provably spins until the next frame: a jump to itself, 00FD, Fx0A with no key down, or an Fx07
+    poll of the running delay timer that came back round to the exact same state, nothing but the timers and the keys can
+    get it out and those only change between frames, so a frontend may skip the rest of the frame */
+    bool idle_flag;
+
+    // things a rom does that no working program does, the machine carries on regardless (an unknown opcode does nothing,
+    // the stack wraps) but a crashed or misconfigured rom almost always hits one
+    enum fault_type
+    {
+        fault_none,
+        // no instruction has this opcode
+        fault_unknown_opcode,
+        // a sixteenth nested call, sp wraps at 16 so a full stack would look empty to the next return
+        fault_stack_overflow,
+        // a return with nothing on the stack
+        fault_stack_underflow,
+        // a jump, call or return to below 0x200 (the interpreter and font area) or past the end of memory
+        fault_bad_address,
+        fault_count
+    };
+    // the first fault since it was last cleared and the address of the instruction behind it, whoever checks clears it
+    // like the flags above
+    fault_type fault;
+    uint16_t fault_pc;
    
 
+    // instruction sets beyond chip8 and super-chip, which is always on
+    enum platform_type
+    {
+        platform_chip8,
+        // 64k memory, F000 NNNN, 5xy2/5xy3, 00DN, four bitplanes selected by Fn01, F002/Fx3A audio
+        platform_xochip,
+        platform_count
+    };
+
+    // execution engines, every engine gives identical results, they only differ in how instructions are dispatched
+    enum engine_type
+    {
+        // nested tables of handler pointers indexed by opcode nibbles, the reference
+        engine_table,
+        // a table of leaf handlers per rom address built at load, see predecode()
+        engine_predecode,
+        // blocks compiled ahead of time into a shared object (see set_native()), predecode for everything else
+        engine_native,
+        engine_count
+    };
+
     chip8();
+    // copying a chip8 is the snapshot/fork operation, memory pages are shared until either side writes to them
 
     void emulate_cycle();
+    // runs count instructions, or stops right after one that raised sound_flag or idle_flag, returns how many ran
+    // native code only runs from here, emulate_cycle() always interprets a single instruction
+    int emulate_cycles(int count);
     bool load_file(const char *filename);
+    // copies a rom image into memory at 0x200
+    bool load_bytes(const uint8_t *data, size_t size);
+    // builds the decode table for the currently loaded rom, later cycles dispatch straight through it
+    void predecode();
+    // takes the memory pages and decode table of an instance that already loaded a rom (see rom_cache.hpp), registers and
+    // the rest of the state are left alone, false without changing anything if the two are on different platforms
+    bool share_rom(const chip8 &prototype);
+    // switches instruction set, call before loading since it resets memory
+    void set_platform(platform_type platform);
+    platform_type platform() const;
+    static const char *platform_name(int platform);
+    // NULL name or unknown gives platform_count
+    static platform_type find_platform(const char *name);
+    // switches engine for the loaded rom, call after loading, engine_native keeps code attached by set_native() and
+    // runs as predecode without it
+    void set_engine(engine_type engine);
+    // attaches native code compiled from the loaded rom for this platform (see load_native()) and switches to
+    // engine_native, NULL detaches it
+    void set_native(std::shared_ptr<const native_program> program);
+    engine_type engine() const;
+    static const char *engine_name(int engine);
+    static const char *fault_name(int fault);
+
+    // the built in quirk profiles, default, chip8, schip and xochip, terminated by an entry with a NULL name
+    static const quirk_profile *quirk_profiles();
+    // NULL if there is no profile with that name
+    static const quirk_profile *find_quirks(const char *name);
+    void set_quirks(const quirk_profile &profile);
+    const quirk_profile &get_quirks() const;
+    // counts both timers down, call 60 times per emulated second
     void decrement_timers(); 
+    // the beeper is on while the sound timer is above zero
+    bool sound_on() const { return sound_timer > 0; }
+    const uint8_t *audio_pattern() const { return audio_pattern_buffer; }
+    uint8_t audio_pitch() const { return audio_pitch_register; }
+
+    // hash of the full machine state (memory, screen, registers, stack, timers), O(1) to read
+    // the keypad is input rather than state, so it is not part of the hash
+    uint64_t state_hash() const;
+    // hash of just the framebuffer, what golden frame tests compare
+    uint64_t screen_hash() const;
+    // 64x32, or 128x64 in super-chip high resolution
+    int screen_width() const;
+    int screen_height() const;
+    bool pixel(int x, int y) const
+    {
+        return (video[y][x >> 6] >> (63 - (x & 63))) & 1;
+    }
+    // 1 outside xo-chip, 4 on it
+    int plane_count() const;
+    // the bits of every plane at x, y, plane 0 in bit 0, what a palette is indexed by
+    int color(int x, int y) const;
+    // true when the next instruction reads the keypad (Ex9E, ExA1, Fx0A), the points where input can change the outcome
+    bool at_input_poll() const;
+    // reseed the op_Cxkk generator, the constructor seeds from the clock
+    void seed(uint32_t value);
+    chip8_registers get_registers() const;
+    // sp is wrapped into the stack like the call instructions do, memory and screen are left alone
+    void set_registers(const chip8_registers &registers);
+    // zobrist-style key for one cell, position selects memory/screen/register, a zero value contributes nothing
+    static uint64_t hash_key(uint32_t position, uint32_t value);
    // bool verify_file(const char* filename); 
     
 
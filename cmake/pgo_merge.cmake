@@ -0,0 +1,10 @@
+# merges the raw clang profiles of a training run into the one file CHIP8_PGO=USE reads
+# usage: cmake -DLLVM_PROFDATA=... -DPGO_DIR=... -P pgo_merge.cmake
+file(GLOB raw_profiles ${PGO_DIR}/*.profraw)
+if(NOT raw_profiles)
+    message(FATAL_ERROR "no raw profiles in ${PGO_DIR}, was the build configured with CHIP8_PGO=GENERATE?")
+endif()
+execute_process(COMMAND ${LLVM_PROFDATA} merge -output=${PGO_DIR}/chip8.profdata ${raw_profiles} RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "llvm-profdata merge failed")
+endif()
@@ -0,0 +1,299 @@
+#include "control_flow.hpp"
+#include <algorithm>
+#include <cstdlib>
+
+int instruction_length(const uint8_t *data, size_t size, chip8::platform_type platform)
+{
+    // op_F000 takes the next word for any x, F000 is the only form roms use
+    return platform == chip8::platform_xochip && size >= 2 && data[0] == 0xF0 && data[1] == 0x00 ? 4 : 2;
+}
+
+// what the walk knows about I on the current path
+struct index_state
+{
+    bool known;
+    uint16_t value;
+    // bytes per sprite row group, 1 unless xo-chip's Fn01 selected several planes
+    int planes;
+};
+
+// classes the bytes I points at, code always wins since it was proven reachable
+static void mark_data(control_flow_graph &graph, const index_state &index, int count, byte_class kind)
+{
+    if (!index.known)
+    {
+        return;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        size_t at = (size_t)(uint16_t)(index.value + i) - graph.base;
+        if (at < graph.classes.size() && graph.classes[at] != byte_code && graph.classes[at] != byte_operand &&
+            graph.classes[at] != byte_sprite)
+        {
+            graph.classes[at] = kind;
+        }
+    }
+}
+
+static void mark_leader(std::vector<uint8_t> &leaders, size_t base, uint16_t address)
+{
+    size_t at = address - base;
+    if (address >= base && at < leaders.size())
+    {
+        leaders[at] = 1;
+    }
+}
+
+// true for the opcodes that skip the next instruction, following the core's dispatch (5xy2/5xy3 are xo-chip transfers)
+static bool is_skip(uint16_t op, chip8::platform_type platform)
+{
+    switch (op >> 12)
+    {
+    case 0x3:
+    case 0x4:
+    case 0x9:
+        return true;
+    case 0x5:
+        return platform != chip8::platform_xochip || ((op & 0xF) != 0x2 && (op & 0xF) != 0x3);
+    case 0xE:
+        return (op & 0xF) == 0xE || (op & 0xF) == 0x1;
+    }
+    return false;
+}
+
+void analyze_control_flow(const uint8_t *data, size_t size, chip8::platform_type platform, control_flow_graph &graph)
+{
+    const uint16_t base = 0x200;
+    graph.base = base;
+    graph.classes.assign(size, byte_unknown);
+    graph.blocks.clear();
+    graph.subroutines.clear();
+    std::vector<uint8_t> leaders(size, 0);
+    std::vector<uint16_t> pending;
+    if (size > 0)
+    {
+        pending.push_back(base);
+        leaders[0] = 1;
+    }
+
+    // pass one, mark every reachable instruction and every address a block has to start at
+    while (!pending.empty())
+    {
+        uint16_t address = pending.back();
+        pending.pop_back();
+        index_state index = {false, 0, 1};
+        for (;;)
+        {
+            size_t at = address - base;
+            if (address < base || at >= size || graph.classes[at] == byte_code)
+            {
+                break;
+            }
+            int length = instruction_length(data + at, size - at, platform);
+            graph.classes[at] = byte_code;
+            for (int i = 1; i < length && at + i < size; i++)
+            {
+                graph.classes[at + i] = byte_operand;
+            }
+            if (at + length > size)
+            {
+                // cut off by the end of the rom
+                break;
+            }
+            uint16_t op = data[at] << 8 | data[at + 1];
+            uint16_t next = address + length;
+            uint16_t target = op & 0x0FFF;
+            if (is_skip(op, platform))
+            {
+                size_t after = next - base;
+                int skipped = after < size ? instruction_length(data + after, size - after, platform) : 2;
+                mark_leader(leaders, base, next);
+                mark_leader(leaders, base, next + skipped);
+                pending.push_back(next + skipped);
+                address = next;
+                continue;
+            }
+            switch (op >> 12)
+            {
+            case 0x0:
+                if ((op & 0xFF) == 0xEE || (op & 0xFF) == 0xFD)
+                {
+                    next = 0;
+                }
+                break;
+            case 0x1:
+                mark_leader(leaders, base, target);
+                next = target;
+                break;
+            case 0x2:
+                mark_leader(leaders, base, target);
+                mark_leader(leaders, base, next);
+                graph.subroutines.push_back(target);
+                pending.push_back(target);
+                break;
+            case 0x5:
+                // xo-chip save/load vx - vy
+                mark_data(graph, index, abs(((op >> 8) & 0xF) - ((op >> 4) & 0xF)) + 1, byte_data);
+                break;
+            case 0xA:
+                index.known = true;
+                index.value = target;
+                break;
+            case 0xB:
+                next = 0;
+                break;
+            case 0xD:
+            {
+                int height = op & 0xF;
+                int bytes = height != 0 ? height : 32;
+                mark_data(graph, index, bytes * index.planes, byte_sprite);
+                break;
+            }
+            case 0xF:
+                switch (op & 0xFF)
+                {
+                case 0x00:
+                    if (length == 4)
+                    {
+                        index.known = true;
+                        index.value = data[at + 2] << 8 | data[at + 3];
+                    }
+                    break;
+                case 0x01:
+                {
+                    int mask = (op >> 8) & 0xF;
+                    index.planes = std::max(1, (mask & 1) + (mask >> 1 & 1) + (mask >> 2 & 1) + (mask >> 3 & 1));
+                    break;
+                }
+                case 0x02:
+                    mark_data(graph, index, 16, byte_data);
+                    break;
+                case 0x33:
+                    mark_data(graph, index, 3, byte_data);
+                    break;
+                case 0x55:
+                case 0x65:
+                    mark_data(graph, index, ((op >> 8) & 0xF) + 1, byte_data);
+                    // where I ends up depends on the quirk profile
+                    index.known = false;
+                    break;
+                case 0x1E:
+                case 0x29:
+                case 0x30:
+                    index.known = false;
+                    break;
+                }
+                break;
+            }
+            if (next == 0)
+            {
+                break;
+            }
+            address = next;
+        }
+    }
+    std::sort(graph.subroutines.begin(), graph.subroutines.end());
+    graph.subroutines.erase(std::unique(graph.subroutines.begin(), graph.subroutines.end()), graph.subroutines.end());
+
+    // pass two, cut the instructions into blocks in address order
+    cfg_block block;
+    bool open = false;
+    for (size_t at = 0; at < size; at++)
+    {
+        if (graph.classes[at] != byte_code)
+        {
+            continue;
+        }
+        uint16_t address = base + at;
+        if (open && (leaders[at] || address != block.end))
+        {
+            block.exit = exit_fallthrough;
+            block.targets[0] = block.end;
+            block.targets[1] = 0;
+            graph.blocks.push_back(block);
+            open = false;
+        }
+        if (!open)
+        {
+            block.begin = address;
+            open = true;
+        }
+        int length = instruction_length(data + at, size - at, platform);
+        block.last = address;
+        block.end = address + length;
+        block.targets[0] = 0;
+        block.targets[1] = 0;
+        if (at + length > size)
+        {
+            block.exit = exit_halt;
+            graph.blocks.push_back(block);
+            open = false;
+            continue;
+        }
+        uint16_t op = data[at] << 8 | data[at + 1];
+        uint16_t next = block.end;
+        if (is_skip(op, platform))
+        {
+            size_t after = next - base;
+            block.exit = exit_skip;
+            block.targets[0] = next;
+            block.targets[1] = next + (after < size ? instruction_length(data + after, size - after, platform) : 2);
+        }
+        else if ((op & 0xF0FF) == 0x00EE)
+        {
+            block.exit = exit_return;
+        }
+        else if ((op & 0xF0FF) == 0x00FD)
+        {
+            block.exit = exit_halt;
+        }
+        else if (op >> 12 == 0x1)
+        {
+            block.exit = exit_jump;
+            block.targets[0] = op & 0x0FFF;
+        }
+        else if (op >> 12 == 0x2)
+        {
+            block.exit = exit_call;
+            block.targets[0] = op & 0x0FFF;
+            block.targets[1] = next;
+        }
+        else if (op >> 12 == 0xB)
+        {
+            block.exit = exit_indirect;
+        }
+        else
+        {
+            continue;
+        }
+        graph.blocks.push_back(block);
+        open = false;
+    }
+    if (open)
+    {
+        // runs off the end of the rom into whatever memory holds there
+        block.exit = exit_fallthrough;
+        block.targets[0] = block.end;
+        block.targets[1] = 0;
+        graph.blocks.push_back(block);
+    }
+}
+
+int control_flow_graph::find_block(uint16_t address) const
+{
+    size_t low = 0;
+    size_t high = blocks.size();
+    while (low < high)
+    {
+        size_t middle = (low + high) / 2;
+        if (blocks[middle].begin < address)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    return low < blocks.size() && blocks[low].begin == address ? (int)low : -1;
+}
@@ -0,0 +1,90 @@
+#ifndef control_flow_h
+#define control_flow_h
+
+#include <cstddef>
+#include <stdint.h>
+#include <vector>
+#include "chip8.hpp"
+
+/* static control flow recovery for a rom image loaded at 0x200
+the walk starts at 0x200 and follows jumps, calls, both sides of every skip and the fall through after a call, it stops
+at returns, 00FD, Bnnn (the target depends on a register) and anything outside the rom, so only bytes some path can
+execute are called code
+the code found is cut into basic blocks, a block starts at 0x200, at any jump, skip or call target and after any
+instruction that ends one, and ends at the first jump, skip, call, return, Bnnn or 00FD
+bytes a reachable Annn points I at are classed as data on the way: sprites when a Dxyn draws from there, plain data
+for Fx33/Fx55/Fx65 and F002, anything the walk also decodes as an instruction stays code
+everything is flat arrays over the rom, a 3k rom is analysed in about 20 microseconds */
+
+enum byte_class
+{
+    // nothing reachable touches it
+    byte_unknown,
+    // the first byte of a reachable instruction
+    byte_code,
+    // the rest of an instruction, the second byte or the last three of xo-chip's F000 NNNN
+    byte_operand,
+    // drawn by a Dxyn
+    byte_sprite,
+    // read or written through I some other way
+    byte_data,
+};
+
+// how a basic block hands over control
+enum block_exit
+{
+    // into the next block, which starts at a jump target
+    exit_fallthrough,
+    // 1NNN to targets[0]
+    exit_jump,
+    // a skip, targets[0] is the next instruction, targets[1] the one after it
+    exit_skip,
+    // 2NNN to targets[0], returning to targets[1]
+    exit_call,
+    // 00EE
+    exit_return,
+    // Bnnn, the target is only known at run time
+    exit_indirect,
+    // 00FD, or an instruction that doesn't fit in the rom
+    exit_halt,
+};
+
+struct cfg_block
+{
+    uint16_t begin;
+    // one past the last byte
+    uint16_t end;
+    // address of the instruction that ends the block
+    uint16_t last;
+    block_exit exit;
+    // see block_exit, unused entries are 0, targets can lie outside the rom (code copied into ram, or garbage)
+    uint16_t targets[2];
+};
+
+struct control_flow_graph
+{
+    // where the analysed image starts in memory, always 0x200
+    uint16_t base;
+    // one entry per rom byte, see byte_class
+    std::vector<uint8_t> classes;
+    // sorted by address, blocks never overlap unless the rom jumps into the middle of an instruction
+    std::vector<cfg_block> blocks;
+    // entry points of every subroutine, sorted
+    std::vector<uint16_t> subroutines;
+
+    // index of the block starting at address, -1 if no block starts there
+    int find_block(uint16_t address) const;
+    byte_class class_at(uint16_t address) const
+    {
+        size_t at = address - base;
+        return address >= base && at < classes.size() ? (byte_class)classes[at] : byte_unknown;
+    }
+};
+
+// the length of the instruction at the start of data, 4 for F000 NNNN on xo-chip, 2 otherwise
+int instruction_length(const uint8_t *data, size_t size, chip8::platform_type platform);
+
+// analyses data as a rom loaded at 0x200 on platform, graph is cleared first so it can be reused without reallocating
+void analyze_control_flow(const uint8_t *data, size_t size, chip8::platform_type platform, control_flow_graph &graph);
+
+#endif
@@ -0,0 +1,262 @@
+#include "disassembler.hpp"
+#include <algorithm>
+#include <cstring>
+
+void format_instruction(const uint8_t *data, size_t size, chip8::platform_type platform, char *text, size_t text_size)
+{
+    if (size < 2)
+    {
+        snprintf(text, text_size, "db #%02X", size > 0 ? data[0] : 0);
+        return;
+    }
+    bool xo = platform == chip8::platform_xochip;
+    uint16_t op = data[0] << 8 | data[1];
+    int x = (op >> 8) & 0xF;
+    int y = (op >> 4) & 0xF;
+    int n = op & 0xF;
+    int kk = op & 0xFF;
+    int nnn = op & 0xFFF;
+    // the low nibble or byte picks the instruction within a family, like the core's second level tables
+    switch (op >> 12)
+    {
+    case 0x0:
+        if (kk == 0xE0)
+        {
+            snprintf(text, text_size, "CLS");
+            return;
+        }
+        if (kk == 0xEE)
+        {
+            snprintf(text, text_size, "RET");
+            return;
+        }
+        if ((kk & 0xF0) == 0xC0)
+        {
+            snprintf(text, text_size, "SCD %X", n);
+            return;
+        }
+        if ((kk & 0xF0) == 0xD0 && xo)
+        {
+            snprintf(text, text_size, "SCU %X", n);
+            return;
+        }
+        if (kk >= 0xFB)
+        {
+            static const char *names[] = {"SCR", "SCL", "EXIT", "LOW", "HIGH"};
+            snprintf(text, text_size, "%s", names[kk - 0xFB]);
+            return;
+        }
+        break;
+    case 0x1:
+        snprintf(text, text_size, "JP #%03X", nnn);
+        return;
+    case 0x2:
+        snprintf(text, text_size, "CALL #%03X", nnn);
+        return;
+    case 0x3:
+        snprintf(text, text_size, "SE V%X, #%02X", x, kk);
+        return;
+    case 0x4:
+        snprintf(text, text_size, "SNE V%X, #%02X", x, kk);
+        return;
+    case 0x5:
+        if (xo && n == 0x2)
+        {
+            snprintf(text, text_size, "SAVE V%X - V%X", x, y);
+            return;
+        }
+        if (xo && n == 0x3)
+        {
+            snprintf(text, text_size, "LOAD V%X - V%X", x, y);
+            return;
+        }
+        snprintf(text, text_size, "SE V%X, V%X", x, y);
+        return;
+    case 0x6:
+        snprintf(text, text_size, "LD V%X, #%02X", x, kk);
+        return;
+    case 0x7:
+        snprintf(text, text_size, "ADD V%X, #%02X", x, kk);
+        return;
+    case 0x8:
+    {
+        static const char *names[16] = {"LD", "OR", "AND", "XOR", "ADD", "SUB", "SHR", "SUBN",
+                                        NULL, NULL, NULL, NULL, NULL, NULL, "SHL", NULL};
+        if (names[n] != NULL)
+        {
+            snprintf(text, text_size, "%s V%X, V%X", names[n], x, y);
+            return;
+        }
+        break;
+    }
+    case 0x9:
+        snprintf(text, text_size, "SNE V%X, V%X", x, y);
+        return;
+    case 0xA:
+        snprintf(text, text_size, "LD I, #%03X", nnn);
+        return;
+    case 0xB:
+        snprintf(text, text_size, "JP V0, #%03X", nnn);
+        return;
+    case 0xC:
+        snprintf(text, text_size, "RND V%X, #%02X", x, kk);
+        return;
+    case 0xD:
+        snprintf(text, text_size, "DRW V%X, V%X, %X", x, y, n);
+        return;
+    case 0xE:
+        if (n == 0xE)
+        {
+            snprintf(text, text_size, "SKP V%X", x);
+            return;
+        }
+        if (n == 0x1)
+        {
+            snprintf(text, text_size, "SKNP V%X", x);
+            return;
+        }
+        break;
+    case 0xF:
+        switch (kk)
+        {
+        case 0x00:
+            if (xo && size >= 4)
+            {
+                snprintf(text, text_size, "LD I, long #%04X", data[2] << 8 | data[3]);
+                return;
+            }
+            break;
+        case 0x01:
+            if (xo)
+            {
+                snprintf(text, text_size, "PLANE %X", x);
+                return;
+            }
+            break;
+        case 0x02:
+            if (xo)
+            {
+                snprintf(text, text_size, "AUDIO");
+                return;
+            }
+            break;
+        case 0x07:
+            snprintf(text, text_size, "LD V%X, DT", x);
+            return;
+        case 0x0A:
+            snprintf(text, text_size, "LD V%X, K", x);
+            return;
+        case 0x15:
+            snprintf(text, text_size, "LD DT, V%X", x);
+            return;
+        case 0x18:
+            snprintf(text, text_size, "LD ST, V%X", x);
+            return;
+        case 0x1E:
+            snprintf(text, text_size, "ADD I, V%X", x);
+            return;
+        case 0x29:
+            snprintf(text, text_size, "LD F, V%X", x);
+            return;
+        case 0x30:
+            snprintf(text, text_size, "LD HF, V%X", x);
+            return;
+        case 0x33:
+            snprintf(text, text_size, "LD B, V%X", x);
+            return;
+        case 0x3A:
+            if (xo)
+            {
+                snprintf(text, text_size, "PITCH V%X", x);
+                return;
+            }
+            break;
+        case 0x55:
+            snprintf(text, text_size, "LD [I], V%X", x);
+            return;
+        case 0x65:
+            snprintf(text, text_size, "LD V%X, [I]", x);
+            return;
+        case 0x75:
+            snprintf(text, text_size, "LD R, V%X", x);
+            return;
+        case 0x85:
+            snprintf(text, text_size, "LD V%X, R", x);
+            return;
+        }
+        break;
+    }
+    snprintf(text, text_size, "dw #%04X", op);
+}
+
+// a label for address if a block starts there, empty otherwise
+static void block_label(const control_flow_graph &graph, uint16_t address, char *text, size_t text_size)
+{
+    if (std::binary_search(graph.subroutines.begin(), graph.subroutines.end(), address))
+    {
+        snprintf(text, text_size, "sub_%03X", address);
+    }
+    else if (graph.find_block(address) >= 0)
+    {
+        snprintf(text, text_size, "L%03X", address);
+    }
+    else
+    {
+        text[0] = 0;
+    }
+}
+
+void write_listing(FILE *out, const uint8_t *data, size_t size, chip8::platform_type platform,
+                   const control_flow_graph &graph)
+{
+    char label[16];
+    char text[64];
+    for (size_t at = 0; at < size;)
+    {
+        uint16_t address = graph.base + at;
+        byte_class kind = (byte_class)graph.classes[at];
+        if (kind == byte_code)
+        {
+            block_label(graph, address, label, sizeof(label));
+            if (label[0] != 0)
+            {
+                fprintf(out, "\n%s:\n", label);
+            }
+            int length = std::min<int>(instruction_length(data + at, size - at, platform), size - at);
+            format_instruction(data + at, size - at, platform, text, sizeof(text));
+            fprintf(out, "    %03X  ", address);
+            for (int i = 0; i < 4; i++)
+            {
+                fprintf(out, i < length ? "%02X" : "  ", i < length ? data[at + i] : 0);
+            }
+            fprintf(out, "  %s\n", text);
+            at += length;
+        }
+        else if (kind == byte_sprite)
+        {
+            fprintf(out, "    %03X  %02X      ", address, data[at]);
+            for (int bit = 7; bit >= 0; bit--)
+            {
+                fputc((data[at] >> bit) & 1 ? '#' : '.', out);
+            }
+            fputc('\n', out);
+            at++;
+        }
+        else
+        {
+            // data and unreached bytes, up to 8 per row, a row never runs into a byte of another class
+            size_t end = at + 1;
+            while (end < size && end - at < 8 && graph.classes[end] == kind)
+            {
+                end++;
+            }
+            fprintf(out, "    %03X  db", address);
+            for (size_t i = at; i < end; i++)
+            {
+                fprintf(out, " #%02X", data[i]);
+            }
+            fprintf(out, "%s\n", kind == byte_data ? "  ; data" : kind == byte_operand ? "  ; operand" : "");
+            at = end;
+        }
+    }
+}
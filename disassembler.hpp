@@ -0,0 +1,23 @@
+#ifndef disassembler_h
+#define disassembler_h
+
+#include <cstddef>
+#include <cstdio>
+#include <stdint.h>
+#include "chip8.hpp"
+#include "control_flow.hpp"
+
+/* text for chip8, super-chip and xo-chip instructions, in the mnemonics of Cowgod's reference (LD, SE, DRW, ...) with the
+Octo names for the xo-chip additions, operands in hex
+opcodes the platform has no instruction for come out as a raw word */
+
+// formats the instruction at the start of data (instruction_length() bytes of it) into text
+void format_instruction(const uint8_t *data, size_t size, chip8::platform_type platform, char *text, size_t text_size);
+
+/* a full listing of a rom analysed by analyze_control_flow(): a label on every block, sub_NNN for subroutine entries and
+LNNN for the rest, code with its address and raw bytes, sprites drawn one row per line and other data as byte rows, and
+bytes nothing reachable touches as plain byte rows as well */
+void write_listing(FILE *out, const uint8_t *data, size_t size, chip8::platform_type platform,
+                   const control_flow_graph &graph);
+
+#endif
@@ -0,0 +1,108 @@
+#include "frame_timing.hpp"
+#include <algorithm>
+
+latency_histogram::latency_histogram()
+{
+    reset();
+}
+
+void latency_histogram::reset()
+{
+    std::fill(buckets, buckets + bucket_count, 0);
+    samples = 0;
+    total = 0;
+    largest = 0;
+}
+
+int latency_histogram::bucket_of(uint64_t value)
+{
+    if (value < (2u << sub_bits))
+    {
+        return (int)value;
+    }
+    // position of the highest set bit, the next sub_bits bits below it pick the bucket inside that power of two
+    int exponent = 63 - __builtin_clzll(value);
+    int sub = (int)(value >> (exponent - sub_bits)) & ((1 << sub_bits) - 1);
+    return (2 << sub_bits) + (exponent - sub_bits - 1) * (1 << sub_bits) + sub;
+}
+
+uint64_t latency_histogram::value_of(int bucket)
+{
+    if (bucket < (2 << sub_bits))
+    {
+        return bucket;
+    }
+    int exponent = (bucket - (2 << sub_bits)) / (1 << sub_bits) + sub_bits + 1;
+    int sub = (bucket - (2 << sub_bits)) % (1 << sub_bits);
+    return ((uint64_t)((1 << sub_bits) + sub)) << (exponent - sub_bits);
+}
+
+void latency_histogram::record(uint64_t value)
+{
+    buckets[bucket_of(value)]++;
+    samples++;
+    total += value;
+    largest = std::max(largest, value);
+}
+
+uint64_t latency_histogram::percentile(double fraction) const
+{
+    if (samples == 0)
+    {
+        return 0;
+    }
+    uint64_t wanted = (uint64_t)(fraction * samples);
+    wanted = std::max<uint64_t>(wanted, 1);
+    uint64_t seen = 0;
+    for (int i = 0; i < bucket_count; i++)
+    {
+        seen += buckets[i];
+        if (seen >= wanted)
+        {
+            // the bucket's lower bound, but never above the largest value actually seen
+            return std::min(value_of(i), largest);
+        }
+    }
+    return largest;
+}
+
+frame_timing::frame_timing()
+{
+    std::fill(last, last + phase_count, 0);
+    std::fill(current, current + phase_count, 0);
+}
+
+void frame_timing::record(frame_phase phase, uint64_t ns)
+{
+    phases[phase].record(ns);
+    current[phase] += ns;
+}
+
+void frame_timing::end_frame()
+{
+    uint64_t sum = 0;
+    for (int i = 0; i < phase_count; i++)
+    {
+        last[i] = current[i];
+        sum += current[i];
+        current[i] = 0;
+    }
+    frames.record(sum);
+}
+
+const char *frame_timing::phase_name(int phase)
+{
+    static const char *names[phase_count] = {"emulate", "events", "render", "sleep"};
+    return phase < phase_count ? names[phase] : "frame";
+}
+
+void frame_timing::print(FILE *out) const
+{
+    fprintf(out, "%-8s %10s %10s %10s %10s %10s\n", "phase", "count", "mean us", "p50 us", "p99 us", "max us");
+    for (int i = 0; i <= phase_count; i++)
+    {
+        const latency_histogram &h = i < phase_count ? phases[i] : frames;
+        fprintf(out, "%-8s %10llu %10.1f %10.1f %10.1f %10.1f\n", phase_name(i), (unsigned long long)h.count(),
+                h.mean() / 1000.0, h.percentile(0.50) / 1000.0, h.percentile(0.99) / 1000.0, h.max() / 1000.0);
+    }
+}
@@ -0,0 +1,90 @@
+#ifndef frame_timing_h
+#define frame_timing_h
+
+#include <chrono>
+#include <cstdio>
+#include <stdint.h>
+
+// monotonic nanoseconds, steady_clock so sleeps and ntp adjustments never show up as negative or huge phases
+inline uint64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/* log-linear histogram in the style of HdrHistogram
+values below 64 get a bucket each, above that every power of two is split into 32 buckets, so any recorded value is
+reported within about 3% while the whole range of uint64 fits in 2048 counters, recording is a couple of shifts and an
+increment */
+class latency_histogram
+{
+public:
+    latency_histogram();
+
+    void record(uint64_t value);
+    void reset();
+
+    // smallest bucket value with at least fraction (0..1) of the samples at or below it
+    uint64_t percentile(double fraction) const;
+    uint64_t max() const { return largest; }
+    uint64_t count() const { return samples; }
+    double mean() const { return samples ? (double)total / samples : 0.0; }
+
+private:
+    static const int sub_bits = 5;
+    static const int bucket_count = 2048;
+
+    static int bucket_of(uint64_t value);
+    static uint64_t value_of(int bucket);
+
+    uint64_t buckets[bucket_count];
+    uint64_t samples;
+    uint64_t total;
+    uint64_t largest;
+};
+
+// the four phases of the frontend's frame loop
+enum frame_phase
+{
+    phase_emulate,
+    phase_events,
+    phase_render,
+    phase_sleep,
+    phase_count
+};
+
+class frame_timing
+{
+public:
+    frame_timing();
+
+    void record(frame_phase phase, uint64_t ns);
+    // closes a frame, the frame histogram gets the sum of the phases recorded since the last call
+    void end_frame();
+    // p50/p99/max per phase and per frame, in microseconds
+    void print(FILE *out) const;
+
+    static const char *phase_name(int phase);
+
+    latency_histogram phases[phase_count];
+    latency_histogram frames;
+    // the most recent frame's phase times, what the on-screen overlay draws
+    uint64_t last[phase_count];
+
+private:
+    uint64_t current[phase_count];
+};
+
+// records the time between construction and destruction as one sample of a phase
+class scoped_timer
+{
+public:
+    scoped_timer(frame_timing &timing, frame_phase phase) : timing(timing), phase(phase), start(now_ns()) {}
+    ~scoped_timer() { timing.record(phase, now_ns() - start); }
+
+private:
+    frame_timing &timing;
+    frame_phase phase;
+    uint64_t start;
+};
+
+#endif
@@ -0,0 +1,104 @@
+#include "headless.hpp"
+#include <cstdlib>
+
+bool parse_input_script(const char *text, std::vector<input_event> &events)
+{
+    events.clear();
+    const char *cursor = text;
+    while (*cursor)
+    {
+        char *end;
+        input_event event;
+        event.frame = strtoul(cursor, &end, 10);
+        if (end == cursor || *end != ':')
+        {
+            return false;
+        }
+        cursor = end + 1;
+        event.key = (uint8_t)strtoul(cursor, &end, 16);
+        if (end == cursor || event.key > 0xF || (*end != '+' && *end != '-'))
+        {
+            return false;
+        }
+        event.down = *end == '+';
+        if (!events.empty() && event.frame < events.back().frame)
+        {
+            return false;
+        }
+        events.push_back(event);
+        cursor = end + 1;
+        if (*cursor == ',')
+        {
+            cursor++;
+        }
+    }
+    return true;
+}
+
+std::vector<input_event> scripted_input(uint32_t frames, uint32_t seed)
+{
+    std::vector<input_event> events;
+    uint32_t state = seed * 2654435761u + 1;
+    for (uint32_t frame = 0; frame + 6 < frames; frame += 12)
+    {
+        state = state * 1664525u + 1013904223u;
+        input_event event;
+        event.key = state >> 28;
+        event.frame = frame;
+        event.down = true;
+        events.push_back(event);
+        event.frame = frame + 6;
+        event.down = false;
+        events.push_back(event);
+    }
+    return events;
+}
+
+headless_result run_headless(chip8 &cpu, const headless_options &options)
+{
+    size_t next_event = 0;
+    for (uint32_t frame = 0; frame < options.frames; frame++)
+    {
+        // input is applied at frame boundaries, which is where the frontend polls SDL as well
+        while (next_event < options.input.size() && options.input[next_event].frame <= frame)
+        {
+            cpu.keypad[options.input[next_event].key] = options.input[next_event].down ? 1 : 0;
+            next_event++;
+        }
+        if (options.audio == NULL)
+        {
+            // the flags are never cleared here, so emulate_cycles() only stops for the first one to go up
+            for (int done = 0; done < options.ipf;)
+            {
+                done += cpu.emulate_cycles(options.ipf - done);
+            }
+            cpu.decrement_timers();
+            continue;
+        }
+        // same frame with sound, every change is stamped with the instruction that made it, like the frontend does
+        uint64_t cycle = (uint64_t)frame * options.ipf;
+        for (int done = 0; done < options.ipf;)
+        {
+            int ran = cpu.emulate_cycles(options.ipf - done);
+            done += ran;
+            cycle += ran;
+            if (cpu.sound_flag)
+            {
+                options.audio->update(cpu, cycle);
+            }
+        }
+        cpu.decrement_timers();
+        if (cpu.sound_flag)
+        {
+            options.audio->update(cpu, cycle);
+        }
+        options.audio->render_until(cycle);
+    }
+
+    headless_result result;
+    result.instructions = (uint64_t)options.frames * options.ipf;
+    result.frames = options.frames;
+    result.state_hash = cpu.state_hash();
+    result.screen_hash = cpu.screen_hash();
+    return result;
+}
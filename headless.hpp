@@ -0,0 +1,48 @@
+#ifndef headless_h
+#define headless_h
+
+#include <stdint.h>
+#include <vector>
+#include "audio.hpp"
+#include "chip8.hpp"
+
+/* runs a chip8 without a window, frame by frame the way the frontend does (ipf instructions, then the timers tick), with
+keypad input driven by a script instead of the keyboard
+used by the headless tool and by everything that needs reproducible runs (benchmarks, conformance, fuzzing) */
+
+struct input_event
+{
+    uint32_t frame;
+    uint8_t key;
+    bool down;
+};
+
+// script syntax: comma separated FRAME:KEY+ (press) or FRAME:KEY- (release), KEY in hex, e.g. "30:5+,40:5-"
+// events must be in frame order
+bool parse_input_script(const char *text, std::vector<input_event> &events);
+
+// deterministic "autoplay" input for benchmarks, every 12 frames one pseudo random key is held down for 6 frames
+std::vector<input_event> scripted_input(uint32_t frames, uint32_t seed);
+
+struct headless_options
+{
+    int ipf;
+    uint32_t frames;
+    std::vector<input_event> input;
+    // when set, the sound is rendered into it as the run goes, its samples are left for the caller
+    audio_renderer *audio;
+
+    headless_options() : ipf(10), frames(600), audio(NULL) {}
+};
+
+struct headless_result
+{
+    uint64_t instructions;
+    uint32_t frames;
+    uint64_t state_hash;
+    uint64_t screen_hash;
+};
+
+headless_result run_headless(chip8 &cpu, const headless_options &options);
+
+#endif
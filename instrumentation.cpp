@@ -0,0 +1,158 @@
+#include "instrumentation.hpp"
+
+#ifdef CHIP8_PROFILE
+
+#include <algorithm>
+
+execution_profile profile_counters;
+
+static const char *class_names[opcode_class_count] = {
+    "00E0", "00EE", "00Cn", "00Dn", "00FB", "00FC", "00FD", "00FE", "00FF", "0nnn",
+    "1nnn", "2nnn", "3xkk", "4xkk", "5xy0", "5xy2", "5xy3", "6xkk", "7xkk",
+    "8xy0", "8xy1", "8xy2", "8xy3", "8xy4", "8xy5", "8xy6", "8xy7", "8xyE", "8xy?",
+    "9xy0", "Annn", "Bnnn", "Cxkk", "Dxyn",
+    "Ex9E", "ExA1", "Ex??",
+    "F000", "Fn01", "F002", "Fx07", "Fx0A", "Fx15", "Fx18", "Fx1E", "Fx29", "Fx30",
+    "Fx33", "Fx3A", "Fx55", "Fx65", "Fx75", "Fx85", "Fx??"};
+
+static const char *skip_names[skip_kind_count] = {"3xkk", "4xkk", "5xy0", "9xy0", "Ex9E", "ExA1"};
+
+opcode_class classify_opcode(uint16_t op)
+{
+    switch (op >> 12)
+    {
+    case 0x0:
+        switch (op)
+        {
+        case 0x00E0: return class_00E0;
+        case 0x00EE: return class_00EE;
+        case 0x00FB: return class_00FB;
+        case 0x00FC: return class_00FC;
+        case 0x00FD: return class_00FD;
+        case 0x00FE: return class_00FE;
+        case 0x00FF: return class_00FF;
+        default:
+            switch (op & 0xFFF0)
+            {
+            case 0x00C0: return class_00Cn;
+            case 0x00D0: return class_00Dn;
+            default: return class_0nnn;
+            }
+        }
+    case 0x5:
+        switch (op & 0x000F)
+        {
+        case 0x2: return class_5xy2;
+        case 0x3: return class_5xy3;
+        default: return class_5xy0;
+        }
+    case 0x8:
+        switch (op & 0x000F)
+        {
+        case 0x0: return class_8xy0;
+        case 0x1: return class_8xy1;
+        case 0x2: return class_8xy2;
+        case 0x3: return class_8xy3;
+        case 0x4: return class_8xy4;
+        case 0x5: return class_8xy5;
+        case 0x6: return class_8xy6;
+        case 0x7: return class_8xy7;
+        case 0xE: return class_8xyE;
+        default: return class_8xyN;
+        }
+    case 0xE:
+        return (op & 0xFF) == 0x9E ? class_Ex9E : (op & 0xFF) == 0xA1 ? class_ExA1 : class_ExNN;
+    case 0xF:
+        switch (op & 0x00FF)
+        {
+        case 0x00: return class_F000;
+        case 0x01: return class_Fn01;
+        case 0x02: return class_F002;
+        case 0x07: return class_Fx07;
+        case 0x0A: return class_Fx0A;
+        case 0x15: return class_Fx15;
+        case 0x18: return class_Fx18;
+        case 0x1E: return class_Fx1E;
+        case 0x29: return class_Fx29;
+        case 0x30: return class_Fx30;
+        case 0x33: return class_Fx33;
+        case 0x3A: return class_Fx3A;
+        case 0x55: return class_Fx55;
+        case 0x65: return class_Fx65;
+        case 0x75: return class_Fx75;
+        case 0x85: return class_Fx85;
+        default: return class_FxNN;
+        }
+    default:
+        // 1nnn..Dxyn go by their leading nibble alone
+        static const opcode_class by_nibble[16] = {
+            class_0nnn, class_1nnn, class_2nnn, class_3xkk, class_4xkk, class_5xy0, class_6xkk, class_7xkk,
+            class_8xyN, class_9xy0, class_Annn, class_Bnnn, class_Cxkk, class_Dxyn, class_ExNN, class_FxNN};
+        return by_nibble[op >> 12];
+    }
+}
+
+void print_profile(FILE *out)
+{
+    uint64_t total = 0;
+    for (int i = 0; i < opcode_class_count; i++)
+    {
+        total += profile_counters.opcodes[i];
+    }
+    if (total == 0)
+    {
+        return;
+    }
+
+    fprintf(out, "\n%llu instructions executed\n\nby opcode:\n", (unsigned long long)total);
+    int order[opcode_class_count];
+    for (int i = 0; i < opcode_class_count; i++)
+    {
+        order[i] = i;
+    }
+    std::sort(order, order + opcode_class_count, [](int a, int b) {
+        return profile_counters.opcodes[a] > profile_counters.opcodes[b];
+    });
+    for (int i = 0; i < opcode_class_count && profile_counters.opcodes[order[i]] > 0; i++)
+    {
+        uint64_t count = profile_counters.opcodes[order[i]];
+        fprintf(out, "  %s %12llu %6.2f%%\n", class_names[order[i]], (unsigned long long)count, 100.0 * count / total);
+    }
+
+    fprintf(out, "\nskips (taken / not taken):\n");
+    for (int i = 0; i < skip_kind_count; i++)
+    {
+        uint64_t taken = profile_counters.skips[i][1];
+        uint64_t not_taken = profile_counters.skips[i][0];
+        if (taken + not_taken > 0)
+        {
+            fprintf(out, "  %s %12llu %12llu %6.2f%% taken\n", skip_names[i], (unsigned long long)taken,
+                    (unsigned long long)not_taken, 100.0 * taken / (taken + not_taken));
+        }
+    }
+
+    // the hottest 20 addresses, a partial sort over an index array so the counters themselves stay in address order
+    static uint16_t addresses[65536];
+    for (int i = 0; i < 65536; i++)
+    {
+        addresses[i] = i;
+    }
+    std::partial_sort(addresses, addresses + 20, addresses + 65536, [](uint16_t a, uint16_t b) {
+        return profile_counters.pcs[a] > profile_counters.pcs[b];
+    });
+    fprintf(out, "\nhot pcs:\n");
+    for (int i = 0; i < 20 && profile_counters.pcs[addresses[i]] > 0; i++)
+    {
+        uint64_t count = profile_counters.pcs[addresses[i]];
+        fprintf(out, "  %03X %12llu %6.2f%%\n", addresses[i], (unsigned long long)count, 100.0 * count / total);
+    }
+}
+
+// prints the report when static objects are torn down at exit, which also covers the frontend's exit(0) paths
+struct profile_reporter
+{
+    ~profile_reporter() { print_profile(stderr); }
+};
+static profile_reporter reporter;
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef instrumentation_h
+#define instrumentation_h
+
+/* opt-in execution counters, compiled in with -DCHIP8_PROFILE
+counts every executed instruction by opcode class and by pc, and every skip instruction by whether it skipped, in flat
+static arrays with no allocation, and prints a report to stderr when the process exits
+without CHIP8_PROFILE the hooks below expand to nothing, so emulate_cycle() compiles exactly as before
+the counters are plain process wide increments, with several emulator threads they are approximate
+the native engine's compiled blocks never pass through emulate_cycle(), so profiled builds interpret everything instead,
+see chip8::emulate_cycles() */
+
+#ifdef CHIP8_PROFILE
+
+#include <cstdio>
+#include <stdint.h>
+
+// classes go by encoding the way the xo-chip tables dispatch, so on plain chip8 an 00Dn or F000 counts under its own
+// class even though it runs as an unknown opcode there
+enum opcode_class
+{
+    class_00E0, class_00EE, class_00Cn, class_00Dn, class_00FB, class_00FC, class_00FD, class_00FE, class_00FF, class_0nnn,
+    class_1nnn, class_2nnn, class_3xkk, class_4xkk, class_5xy0, class_5xy2, class_5xy3, class_6xkk, class_7xkk,
+    class_8xy0, class_8xy1, class_8xy2, class_8xy3, class_8xy4, class_8xy5, class_8xy6, class_8xy7, class_8xyE, class_8xyN,
+    class_9xy0, class_Annn, class_Bnnn, class_Cxkk, class_Dxyn,
+    class_Ex9E, class_ExA1, class_ExNN,
+    class_F000, class_Fn01, class_F002, class_Fx07, class_Fx0A, class_Fx15, class_Fx18, class_Fx1E, class_Fx29, class_Fx30,
+    class_Fx33, class_Fx3A, class_Fx55, class_Fx65, class_Fx75, class_Fx85, class_FxNN,
+    opcode_class_count
+};
+
+enum skip_kind
+{
+    skip_3xkk, skip_4xkk, skip_5xy0, skip_9xy0, skip_Ex9E, skip_ExA1,
+    skip_kind_count
+};
+
+struct execution_profile
+{
+    uint64_t opcodes[opcode_class_count];
+    // every address of xo-chip's 64k, plain chip8 only ever uses the first 4k
+    uint64_t pcs[65536];
+    // [kind][0] not taken, [kind][1] taken
+    uint64_t skips[skip_kind_count][2];
+};
+
+extern execution_profile profile_counters;
+
+opcode_class classify_opcode(uint16_t op);
+void print_profile(FILE *out);
+
+#define CHIP8_PROFILE_CYCLE(pc, op)                          \
+    do                                                       \
+    {                                                        \
+        profile_counters.opcodes[classify_opcode(op)]++;     \
+        profile_counters.pcs[(uint16_t)(pc)]++;              \
+    } while (0)
+#define CHIP8_PROFILE_SKIP(kind, taken) (profile_counters.skips[kind][(taken) ? 1 : 0]++)
+
+#else
+
+#define CHIP8_PROFILE_CYCLE(pc, op)
+#define CHIP8_PROFILE_SKIP(kind, taken)
+
+#endif
+
+#endif
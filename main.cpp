@@ -1,9 +1,19 @@
 #include <iostream>
 #include <SDL2/SDL.h>
 // #include <glad/glad.h>
+#include "adaptive_ipf.hpp"
+#include "audio.hpp"
 #include "chip8.hpp"
+#include "frame_timing.hpp"
+#include "mapped_file.hpp"
+#include "recompiler.hpp"
+#include "rom_cache.hpp"
+#include "rom_config.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
 #include <thread>
-#include <unistd.h>
 
 // clang++ main.cpp ./glad/src/glad.c -I/Library/Frameworks/SDL2.framework/Headers -I./glad/include -F/Library/Frameworks -framework SDL2
 
@@ -26,18 +36,267 @@ unsigned short keymap[16] = {
     SDLK_v,
 };
 
+// argb for each xo-chip color index, plane 0 alone is the classic white on black, a rom's config can replace them
+uint32_t palette[16] = {
+    0xFF000000, 0xFFFFFFFF, 0xFFAAAAAA, 0xFF555555, 0xFFFF0000, 0xFF00FF00, 0xFF0000FF, 0xFFFFFF00,
+    0xFF880000, 0xFF008800, 0xFF000088, 0xFF888800, 0xFFFF00FF, 0xFF00FFFF, 0xFF880088, 0xFF008888,
+};
+
+// colors of the overlay bars, one per frame_phase
+const Uint8 phase_colors[phase_count][3] = {
+    {0x40, 0xC0, 0x40}, // emulate
+    {0x40, 0x80, 0xFF}, // events
+    {0xFF, 0x50, 0x40}, // render
+    {0x80, 0x80, 0x80}, // sleep
+};
+
+// sdl pulls samples on its own thread, straight out of the ring the emulation loop writes
+void audio_callback(void *userdata, Uint8 *stream, int length)
+{
+    static_cast<audio_output *>(userdata)->read(reinterpret_cast<int16_t *>(stream), length / (int)sizeof(int16_t));
+}
+
+// draws the last frame's phase times as horizontal bars along the top of the window, full width is 20 ms
+void draw_timing_overlay(SDL_Renderer *renderer, const frame_timing &timing)
+{
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+    for (int i = 0; i < phase_count; i++)
+    {
+        SDL_Rect bar;
+        bar.x = 0;
+        bar.y = i * 8;
+        bar.w = (int)std::min<uint64_t>(640, timing.last[i] * 640 / 20000000);
+        bar.h = 6;
+        SDL_SetRenderDrawColor(renderer, phase_colors[i][0], phase_colors[i][1], phase_colors[i][2], 0xC0);
+        SDL_RenderFillRect(renderer, &bar);
+    }
+}
+
+// sound is stamped on a clock of 800 ticks per emulated frame, one per sample at 48 kHz, so it does not depend on how
+// many instructions a frame runs
+const int ticks_per_frame = 800;
+
+// one emulated frame, the ipf speed picked then the 60 Hz timer tick, with the sound rendered as it goes, speed hears back
+// how many instructions actually ran (fewer when the rom went idle) and how long that took
+// fast-forward runs more of these per display refresh, so timers and sound always follow emulated time, but only the last
+// one of each refresh is audible, the sound comes out as a steady refresh sized slice of every few frames
+void emulate_frame(chip8 &cpu, adaptive_ipf &speed, uint64_t &frame, audio_renderer &sound, bool audible)
+{
+    uint64_t begin = speed.adjustable() ? now_ns() : 0;
+    int ipf = speed.ipf();
+    uint64_t start = frame * ticks_per_frame;
+    if (!audible)
+    {
+        sound.skip_until(start + ticks_per_frame);
+    }
+    int executed = 0;
+    while (executed < ipf)
+    {
+        // stops early right after an instruction that raised one of the flags below
+        executed += cpu.emulate_cycles(ipf - executed);
+        // sound changes are stamped with the instruction that made them
+        if (cpu.sound_flag)
+        {
+            sound.update(cpu, start + (uint64_t)executed * ticks_per_frame / ipf);
+        }
+        // the rest of the frame would go round the same spin loop, the host can sleep instead
+        if (cpu.idle_flag)
+        {
+            cpu.idle_flag = false;
+            break;
+        }
+    }
+    frame++;
+
+    cpu.decrement_timers();
+    if (cpu.sound_flag)
+    {
+        sound.update(cpu, frame * ticks_per_frame);
+    }
+    sound.render_until(frame * ticks_per_frame);
+    if (speed.adjustable())
+    {
+        speed.record(executed, now_ns() - begin);
+    }
+}
+
+// the fast-forward state, then the overlay's timing summary when there is one
+void set_title(SDL_Window *window, bool fast_forward, int turbo, const char *stats)
+{
+    char title[192];
+    if (!fast_forward)
+    {
+        snprintf(title, sizeof(title), "Chip8 Emulator");
+    }
+    else if (turbo > 0)
+    {
+        snprintf(title, sizeof(title), "Chip8 Emulator - fast-forward %dx", turbo);
+    }
+    else
+    {
+        snprintf(title, sizeof(title), "Chip8 Emulator - fast-forward uncapped");
+    }
+    if (stats != NULL && stats[0] != 0)
+    {
+        size_t length = strlen(title);
+        snprintf(title + length, sizeof(title) - length, " - %s", stats);
+    }
+    SDL_SetWindowTitle(window, title);
+}
+
 int main(int argc, char *argv[])
 {
+    // usage: chip8_emulator ROM [--config FILE] [--platform chip8|xochip] [--quirks NAME]
+    //                           [--engine table|predecode|native] [--ipf N] [--adaptive] [--max-ipf N] [--turbo N]
+    //                           [--fast-forward]
+    // --ipf sets instructions per frame (default 10), --adaptive lets it rise from there up to --max-ipf while the rom
+    // stays busy and the host has time, see adaptive_ipf.hpp
+    // tab toggles fast-forward, at --turbo times normal speed, or as fast as the host goes with 0 (the default)
+    // --config names the per rom settings file (default chip8.ini, see rom_config.hpp), the rom's section fills in
+    // whatever the command line leaves out
     if (argc <= 1)
     {
         exit(1);
     }
 
     chip8 cpu;
-    if (!cpu.load_file(argv[1]))
+    int turbo = 0;
+    bool fast_forward = false;
+    const char *config_file = NULL;
+    // unset until the command line or the config says otherwise, the defaults fill in the rest
+    int ipf = 0;
+    int max_ipf = 0;
+    int adaptive = -1;
+    chip8::platform_type platform = chip8::platform_count;
+    const quirk_profile *quirks = NULL;
+    int engine = chip8::engine_count;
+    for (int i = 2; i < argc; i++)
+    {
+        bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--turbo") == 0 && has_value)
+        {
+            turbo = atoi(argv[++i]);
+            if (turbo < 0)
+            {
+                fprintf(stderr, "turbo has to be 0 (uncapped) or a speed multiplier\n");
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--ipf") == 0 && has_value)
+        {
+            ipf = atoi(argv[++i]);
+            if (ipf < 1)
+            {
+                fprintf(stderr, "instructions per frame have to be at least 1\n");
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--max-ipf") == 0 && has_value)
+        {
+            max_ipf = atoi(argv[++i]);
+            if (max_ipf < 1)
+            {
+                fprintf(stderr, "instructions per frame have to be at least 1\n");
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--adaptive") == 0)
+        {
+            adaptive = 1;
+        }
+        else if (strcmp(argv[i], "--fast-forward") == 0)
+        {
+            fast_forward = true;
+        }
+        else if (strcmp(argv[i], "--config") == 0 && has_value)
+        {
+            config_file = argv[++i];
+        }
+        else if (strcmp(argv[i], "--platform") == 0 && has_value)
+        {
+            platform = chip8::find_platform(argv[++i]);
+            if (platform == chip8::platform_count)
+            {
+                fprintf(stderr, "unknown platform %s\n", argv[i]);
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--quirks") == 0 && has_value)
+        {
+            quirks = chip8::find_quirks(argv[++i]);
+            if (quirks == NULL)
+            {
+                fprintf(stderr, "unknown quirk profile %s\n", argv[i]);
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--engine") == 0 && has_value)
+        {
+            const char *name = argv[++i];
+            for (engine = 0; engine < chip8::engine_count && strcmp(chip8::engine_name(engine), name) != 0; engine++)
+            {
+            }
+            if (engine == chip8::engine_count)
+            {
+                fprintf(stderr, "unknown engine %s\n", name);
+                exit(1);
+            }
+        }
+    }
+
+    mapped_file rom;
+    if (!rom.open(argv[1]))
     {
         exit(1);
     }
+    // a missing default file just means no per rom settings, one named on the command line has to be there
+    rom_config config;
+    if (!config.load(config_file != NULL ? config_file : "chip8.ini") && config_file != NULL)
+    {
+        fprintf(stderr, "could not read %s\n", config_file);
+        exit(1);
+    }
+    rom_settings settings;
+    if (config.find(content_hash(rom.data(), rom.size()), settings))
+    {
+        ipf = ipf != 0 ? ipf : settings.ipf;
+        max_ipf = max_ipf != 0 ? max_ipf : settings.max_ipf;
+        adaptive = adaptive != -1 ? adaptive : settings.adaptive;
+        platform = platform != chip8::platform_count ? platform : settings.platform;
+        quirks = quirks != NULL ? quirks : settings.quirks;
+        engine = engine != chip8::engine_count ? engine : settings.engine;
+        // printable keys have the character as their sdl keycode
+        for (size_t i = 0; i < settings.keymap.size(); i++)
+        {
+            keymap[i] = settings.keymap[i];
+        }
+        std::copy(settings.palette, settings.palette + settings.palette_size, palette);
+    }
+    ipf = ipf != 0 ? ipf : 10;
+    max_ipf = max_ipf != 0 ? max_ipf : 100;
+
+    if (platform != chip8::platform_count)
+    {
+        cpu.set_platform(platform);
+    }
+    if (!cpu.load_bytes(rom.data(), rom.size()))
+    {
+        exit(1);
+    }
+    if (quirks != NULL)
+    {
+        cpu.set_quirks(*quirks);
+    }
+    if (engine != chip8::engine_count)
+    {
+        cpu.set_engine((chip8::engine_type)engine);
+    }
+    // the first launch of a rom compiles it, later ones load the cached object, predecode runs it if that fails
+    if (engine == chip8::engine_native)
+    {
+        cpu.set_native(load_native(rom.data(), rom.size(), cpu.platform(), default_native_cache().c_str()));
+    }
+    rom.close();
 
     SDL_Window *window;
     SDL_Renderer *renderer;
@@ -63,77 +322,200 @@ int main(int argc, char *argv[])
     }
 
     SDL_RenderSetLogicalSize(renderer, 640, 320);
-    texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, 64, 32);
+    // sized for super-chip high resolution, low resolution frames only use the top left 64x32 of it
+    texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, 128, 64);
     if (texture == nullptr)
     {
         SDL_Quit();
         exit(1);
     }
 
-    while (true)
+    // the part of the texture the current resolution uses
+    SDL_Rect screen = {0, 0, 64, 32};
+
+    // sound is rendered in emulated time and played through a small ring buffer, a 256 sample device buffer is 5 ms at
+    // 48 kHz on top of that, without an audio device the emulator just runs silent
+    audio_renderer sound(48000, ticks_per_frame * 60);
+    audio_output speaker(48000);
+    SDL_AudioSpec wanted;
+    SDL_AudioSpec obtained;
+    SDL_zero(wanted);
+    wanted.freq = 48000;
+    wanted.format = AUDIO_S16SYS;
+    wanted.channels = 1;
+    wanted.samples = 256;
+    wanted.callback = audio_callback;
+    wanted.userdata = &speaker;
+    SDL_AudioDeviceID audio_device = SDL_OpenAudioDevice(NULL, 0, &wanted, &obtained, 0);
+    if (audio_device != 0)
     {
-        for (int i = 0; i < 10; ++i){
-            cpu.emulate_cycle();
-        }
-        
-        cpu.decrement_timers();
+        SDL_PauseAudioDevice(audio_device, 0);
+    }
+    uint64_t frame = 0;
+
+    frame_timing timing;
+    bool show_overlay = false;
+    // the overlay's last percentiles, shown in the title while it is up
+    char stats[128] = "";
+    bool running = true;
+    uint64_t title_time = now_ns();
+    set_title(window, fast_forward, turbo, NULL);
+
+    // emulation may take half of each refresh before adaptive ipf backs off, without --adaptive the ipf is pinned
+    adaptive_ipf speed(ipf, adaptive == 1 ? max_ipf : ipf, 1000000000 / 120);
+
+    // the loop runs once per display refresh and presents at most one frame, in fast-forward the emulated frames in
+    // between are never rendered
+    const uint64_t refresh_ns = 1000000000 / 60;
+    uint64_t deadline = now_ns() + refresh_ns;
 
-        SDL_Event event;
-        while (SDL_PollEvent(&event))
+    while (running)
+    {
         {
-            if (event.type == SDL_QUIT)
+            scoped_timer timer(timing, phase_emulate);
+            if (fast_forward && turbo > 0)
+            {
+                for (int i = 1; i < turbo; i++)
+                {
+                    emulate_frame(cpu, speed, frame, sound, false);
+                }
+            }
+            else if (fast_forward)
             {
-                // log_file.close();
-                exit(0);
+                // uncapped, emulate until a quarter of the refresh is left for events and rendering
+                uint64_t stop = deadline - refresh_ns / 4;
+                while (now_ns() < stop)
+                {
+                    emulate_frame(cpu, speed, frame, sound, false);
+                }
             }
-            if (event.type == SDL_KEYDOWN)
+            emulate_frame(cpu, speed, frame, sound, true);
+            if (audio_device != 0)
             {
-                if (event.key.keysym.sym == SDLK_ESCAPE)
+                speaker.write(sound.samples.data(), sound.samples.size());
+            }
+            sound.samples.clear();
+        }
+
+        {
+            scoped_timer timer(timing, phase_events);
+            SDL_Event event;
+            while (SDL_PollEvent(&event))
+            {
+                if (event.type == SDL_QUIT)
                 {
-                    // log_file.close();
-                    exit(0);
+                    running = false;
                 }
-                for (int i = 0; i < 16; i++)
+                if (event.type == SDL_KEYDOWN)
                 {
-                    if (event.key.keysym.sym == keymap[i])
+                    if (event.key.keysym.sym == SDLK_ESCAPE)
                     {
-                        cpu.keypad[i] = 1;
+                        running = false;
+                    }
+                    // tab toggles fast-forward
+                    if (event.key.keysym.sym == SDLK_TAB && !event.key.repeat)
+                    {
+                        fast_forward = !fast_forward;
+                        set_title(window, fast_forward, turbo, show_overlay ? stats : NULL);
+                    }
+                    // F1 toggles the frame timing overlay
+                    if (event.key.keysym.sym == SDLK_F1)
+                    {
+                        show_overlay = !show_overlay;
+                        cpu.draw_flag = true;
+                        set_title(window, fast_forward, turbo, show_overlay ? stats : NULL);
+                    }
+                    for (int i = 0; i < 16; i++)
+                    {
+                        if (event.key.keysym.sym == keymap[i])
+                        {
+                            cpu.keypad[i] = 1;
+                        }
                     }
                 }
-            }
 
-            if (event.type == SDL_KEYUP)
-            {
-                for (int i = 0; i < 16; i++)
+                if (event.type == SDL_KEYUP)
                 {
-                    if (event.key.keysym.sym == keymap[i])
+                    for (int i = 0; i < 16; i++)
                     {
-                        cpu.keypad[i] = 0;
+                        if (event.key.keysym.sym == keymap[i])
+                        {
+                            cpu.keypad[i] = 0;
+                        }
                     }
                 }
             }
         }
-        if (cpu.draw_flag)
+
         {
-            cpu.draw_flag = false;
-            uint32_t pixels[32 * 64];
-            for (int i = 0; i < 2048; i++)
+            scoped_timer timer(timing, phase_render);
+            // with the overlay up every frame is presented so the bars stay live
+            if (cpu.draw_flag || show_overlay)
             {
-                if (cpu.video[i] == 0)
+                if (cpu.draw_flag)
                 {
-                    pixels[i] = 0xFF000000;
+                    cpu.draw_flag = false;
+                    screen.w = cpu.screen_width();
+                    screen.h = cpu.screen_height();
+                    // unpack the framebuffer rows a bit at a time, msb first, combining the planes into a palette index
+                    uint32_t pixels[64 * 128];
+                    for (int y = 0; y < screen.h; y++)
+                    {
+                        for (int x = 0; x < screen.w; x++)
+                        {
+                            pixels[y * screen.w + x] = palette[cpu.color(x, y)];
+                        }
+                    }
+                    SDL_UpdateTexture(texture, &screen, pixels, screen.w * sizeof(uint32_t));
                 }
-                else
+                SDL_RenderClear(renderer);
+                SDL_RenderCopy(renderer, texture, &screen, NULL);
+                if (show_overlay)
                 {
-                    pixels[i] = 0xFFFFFFFF;
+                    draw_timing_overlay(renderer, timing);
                 }
+                SDL_RenderPresent(renderer);
+            }
+        }
+
+        {
+            scoped_timer timer(timing, phase_sleep);
+            uint64_t now = now_ns();
+            if (now < deadline)
+            {
+                std::this_thread::sleep_for(std::chrono::nanoseconds(deadline - now));
+            }
+            // more than a refresh behind (a slow frame, or the window being dragged) starts the schedule over instead of
+            // rushing through the missed frames
+            deadline += refresh_ns;
+            if (deadline < now_ns())
+            {
+                deadline = now_ns() + refresh_ns;
             }
-            SDL_UpdateTexture(texture, NULL, pixels, 64 * sizeof(uint32_t));
-            SDL_RenderClear(renderer);
-            SDL_RenderCopy(renderer, texture, NULL, NULL);
-            SDL_RenderPresent(renderer);
         }
+        timing.end_frame();
+
+        // with the overlay up, the title carries the running frame time percentiles, refreshed once a second
+        if (show_overlay && now_ns() - title_time > 1000000000)
+        {
+            snprintf(stats, sizeof(stats), "frame p50 %.1f ms, p99 %.1f ms, emulate p99 %.2f ms, ipf %d",
+                     timing.frames.percentile(0.50) / 1e6, timing.frames.percentile(0.99) / 1e6,
+                     timing.phases[phase_emulate].percentile(0.99) / 1e6, speed.ipf());
+            set_title(window, fast_forward, turbo, stats);
+            title_time = now_ns();
+        }
+    }
+
+    timing.print(stdout);
 
-        usleep(16000);
+    if (audio_device != 0)
+    {
+        SDL_CloseAudioDevice(audio_device);
     }
-}
\ No newline at end of file
+
+    SDL_DestroyTexture(texture);
+    SDL_DestroyRenderer(renderer);
+    SDL_DestroyWindow(window);
+    SDL_Quit();
+    return 0;
+}
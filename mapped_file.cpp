@@ -0,0 +1,54 @@
+#include "mapped_file.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+mapped_file::mapped_file() : bytes(NULL), length(0), modified(0) {}
+
+mapped_file::~mapped_file()
+{
+    close();
+}
+
+bool mapped_file::open(const char *filename)
+{
+    close();
+    int fd = ::open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode))
+    {
+        ::close(fd);
+        return false;
+    }
+    modified = info.st_mtime;
+    // an empty file is a valid (if useless) rom, mmap refuses zero length so there is nothing to map
+    if (info.st_size > 0)
+    {
+        void *mapping = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED)
+        {
+            ::close(fd);
+            return false;
+        }
+        bytes = (const uint8_t *)mapping;
+        length = info.st_size;
+    }
+    ::close(fd);
+    return true;
+}
+
+void mapped_file::close()
+{
+    if (bytes != NULL)
+    {
+        munmap((void *)bytes, length);
+    }
+    bytes = NULL;
+    length = 0;
+    modified = 0;
+}
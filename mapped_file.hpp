@@ -0,0 +1,32 @@
+#ifndef mapped_file_h
+#define mapped_file_h
+
+#include <cstddef>
+#include <ctime>
+#include <stdint.h>
+
+// read only mmap of a whole file, unmapped when the object goes away
+// roms are a few kilobytes, so mapping them is a page cache hit instead of a seek/read through a stream
+class mapped_file
+{
+public:
+    mapped_file();
+    ~mapped_file();
+
+    bool open(const char *filename);
+    void close();
+
+    const uint8_t *data() const { return bytes; }
+    size_t size() const { return length; }
+    time_t mtime() const { return modified; }
+
+private:
+    mapped_file(const mapped_file &);
+    mapped_file &operator=(const mapped_file &);
+
+    const uint8_t *bytes;
+    size_t length;
+    time_t modified;
+};
+
+#endif
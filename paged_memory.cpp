@@ -0,0 +1,45 @@
+#include "paged_memory.hpp"
+
+// the page every fresh memory starts out pointing at, it is never written since its use count never drops to 1
+const std::shared_ptr<paged_memory::page> &paged_memory::zero_page()
+{
+    static const std::shared_ptr<page> zero = std::make_shared<page>(page());
+    return zero;
+}
+
+paged_memory::paged_memory(size_t size)
+    : pages(size / page_size, zero_page()), mask(size - 1)
+{
+}
+
+void paged_memory::write(uint16_t address, uint8_t value)
+{
+    address &= mask;
+    std::shared_ptr<page> &target = pages[address >> page_bits];
+    uint8_t &byte = target->bytes[address & (page_size - 1)];
+    if (byte == value)
+    {
+        // storing what is already there must not unshare the page
+        return;
+    }
+    // another copy still references this page, so take a private copy before writing
+    // use_count() == 1 means nobody else can be holding it, any other copy would have to come through this object
+    if (target.use_count() != 1)
+    {
+        target = std::make_shared<page>(*target);
+    }
+    target->bytes[address & (page_size - 1)] = value;
+}
+
+size_t paged_memory::shared_pages() const
+{
+    size_t count = 0;
+    for (size_t i = 0; i < pages.size(); i++)
+    {
+        if (pages[i].use_count() > 1)
+        {
+            count++;
+        }
+    }
+    return count;
+}
@@ -0,0 +1,47 @@
+#ifndef paged_memory_h
+#define paged_memory_h
+
+#include <cstddef>
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+/* emulated memory split into refcounted 256 byte pages
+copying a paged_memory only copies the page pointers, a page is duplicated the first time a write hits it while another copy
+still shares it (copy on write), so forking a machine costs a few pointer copies and the font and rom pages that never change
+stay shared between every copy
+untouched pages all point at one process wide zero page */
+class paged_memory
+{
+public:
+    static const int page_bits = 8;
+    static const int page_size = 1 << page_bits;
+
+    // size must be a power of two and a multiple of page_size, addresses wrap at size
+    explicit paged_memory(size_t size);
+
+    uint8_t read(uint16_t address) const
+    {
+        address &= mask;
+        return pages[address >> page_bits]->bytes[address & (page_size - 1)];
+    }
+
+    void write(uint16_t address, uint8_t value);
+
+    size_t size() const { return (size_t)mask + 1; }
+    // number of pages this copy shares with at least one other copy, for diagnostics
+    size_t shared_pages() const;
+
+private:
+    struct page
+    {
+        uint8_t bytes[page_size];
+    };
+
+    static const std::shared_ptr<page> &zero_page();
+
+    std::vector<std::shared_ptr<page> > pages;
+    uint16_t mask;
+};
+
+#endif
@@ -0,0 +1,139 @@
+#include "perf_counters.hpp"
+
+#ifdef __linux__
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+perf_counters::perf_counters()
+{
+    for (int i = 0; i < counter_count; i++)
+    {
+        fds[i] = -1;
+    }
+}
+
+perf_counters::~perf_counters()
+{
+#ifdef __linux__
+    for (int i = 0; i < counter_count; i++)
+    {
+        if (fds[i] >= 0)
+        {
+            close(fds[i]);
+        }
+    }
+#endif
+}
+
+const char *perf_counters::name(int which)
+{
+    static const char *names[counter_count] = {"cycles", "instructions", "branch-misses", "L1d-misses"};
+    return which >= 0 && which < counter_count ? names[which] : "unknown";
+}
+
+#ifdef __linux__
+
+bool perf_counters::open()
+{
+    bool any = false;
+    for (int i = 0; i < counter_count; i++)
+    {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.disabled = 1;
+        // user space only, which is also what perf_event_paranoid=2 still permits
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        attr.type = PERF_TYPE_HARDWARE;
+        switch (i)
+        {
+        case cycles:
+            attr.config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case instructions:
+            attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case branch_misses:
+            attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+            break;
+        case l1d_misses:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            break;
+        }
+        fds[i] = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+        any = any || fds[i] >= 0;
+    }
+    return any;
+}
+
+void perf_counters::start()
+{
+    for (int i = 0; i < counter_count; i++)
+    {
+        if (fds[i] >= 0)
+        {
+            ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+void perf_counters::stop()
+{
+    for (int i = 0; i < counter_count; i++)
+    {
+        if (fds[i] >= 0)
+        {
+            ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+}
+
+uint64_t perf_counters::value(counter which) const
+{
+    if (fds[which] < 0)
+    {
+        return 0;
+    }
+    // value, time enabled, time running
+    uint64_t data[3];
+    if (read(fds[which], data, sizeof(data)) != sizeof(data))
+    {
+        return 0;
+    }
+    if (data[2] == 0)
+    {
+        return 0;
+    }
+    if (data[2] < data[1])
+    {
+        return (uint64_t)((double)data[0] * data[1] / data[2]);
+    }
+    return data[0];
+}
+
+#else
+
+bool perf_counters::open()
+{
+    return false;
+}
+
+void perf_counters::start() {}
+
+void perf_counters::stop() {}
+
+uint64_t perf_counters::value(counter) const
+{
+    return 0;
+}
+
+#endif
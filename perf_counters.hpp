@@ -0,0 +1,42 @@
+#ifndef perf_counters_h
+#define perf_counters_h
+
+#include <stdint.h>
+
+/* hardware counters through linux perf_event_open, counting user space only for the calling thread
+every counter is opened on its own, so a machine (or container, or perf_event_paranoid setting) that lacks one still gets
+the others, and on other platforms nothing is available and the reads are all zero */
+class perf_counters
+{
+public:
+    enum counter
+    {
+        cycles,
+        instructions,
+        branch_misses,
+        l1d_misses,
+        counter_count
+    };
+
+    perf_counters();
+    ~perf_counters();
+
+    // opens whatever counters the host allows, returns false if none could be opened
+    bool open();
+    void start();
+    void stop();
+
+    bool available(counter which) const { return fds[which] >= 0; }
+    // counts accumulated between start() and stop(), scaled up if the kernel had to multiplex the counter
+    uint64_t value(counter which) const;
+
+    static const char *name(int which);
+
+private:
+    perf_counters(const perf_counters &);
+    perf_counters &operator=(const perf_counters &);
+
+    int fds[counter_count];
+};
+
+#endif
@@ -0,0 +1,636 @@
+#include "recompiler.hpp"
+#include "control_flow.hpp"
+#include "disassembler.hpp"
+#include "rom_cache.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <dlfcn.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// the tables a shared object exports, spelled out again in source_header below
+struct native_block_info
+{
+    uint16_t begin;
+    uint16_t end;
+    chip8_native_block function;
+};
+
+struct native_entry
+{
+    uint16_t address;
+    uint16_t block;
+};
+
+// the top of every generated source, has to stay identical to chip8_native_context and the two structs above
+static const char *source_header =
+    "#include <stdint.h>\n"
+    "\n"
+    "struct chip8_native_context\n"
+    "{\n"
+    "    uint8_t *V;\n"
+    "    uint16_t *I;\n"
+    "    uint16_t *pc;\n"
+    "    uint16_t *stack;\n"
+    "    uint8_t *sp;\n"
+    "    const unsigned short *keypad;\n"
+    "    uint16_t address_mask;\n"
+    "    uint8_t vf_reset;\n"
+    "    uint8_t shift_vy;\n"
+    "    uint8_t stop;\n"
+    "    void (*interpret)(chip8_native_context *context);\n"
+    "    void *machine;\n"
+    "};\n"
+    "\n"
+    "typedef int (*chip8_native_block)(chip8_native_context *context, int budget);\n"
+    "\n"
+    "struct native_block_info\n"
+    "{\n"
+    "    uint16_t begin;\n"
+    "    uint16_t end;\n"
+    "    chip8_native_block function;\n"
+    "};\n"
+    "\n"
+    "struct native_entry\n"
+    "{\n"
+    "    uint16_t address;\n"
+    "    uint16_t block;\n"
+    "};\n";
+
+// what the generated code does with one instruction
+enum native_kind
+{
+    // hands it to the core
+    kind_interpret,
+    // register work, carries on with the next instruction
+    kind_register,
+    kind_skip,
+    kind_jump,
+    kind_call,
+    kind_return,
+};
+
+// bit r for Vr, this one for I
+const uint32_t index_bit = 1 << 16;
+
+/* how the instruction at data + at is translated, with the registers its native code reads or writes (used) and the
+ones it writes (written), the decoding follows the core's tables, so e.g. 8xy8 or ExF2 go to op_NULL through the core
+instructions running past the end of the rom read whatever memory holds there, the core does those as well */
+static native_kind classify(const uint8_t *data, size_t at, size_t size, chip8::platform_type platform, uint32_t &used,
+                            uint32_t &written)
+{
+    used = 0;
+    written = 0;
+    if (at + 2 > size)
+    {
+        return kind_interpret;
+    }
+    bool xo = platform == chip8::platform_xochip;
+    uint16_t op = data[at] << 8 | data[at + 1];
+    uint32_t x = 1 << ((op >> 8) & 0xF);
+    uint32_t y = 1 << ((op >> 4) & 0xF);
+    uint32_t f = 1 << 0xF;
+    int n = op & 0xF;
+    switch (op >> 12)
+    {
+    case 0x0:
+        return (op & 0xF0FF) == 0x00EE ? kind_return : kind_interpret;
+    case 0x1:
+        return kind_jump;
+    case 0x2:
+        return kind_call;
+    case 0x3:
+    case 0x4:
+        used = x;
+        break;
+    case 0x5:
+        if (xo && (n == 0x2 || n == 0x3))
+        {
+            return kind_interpret;
+        }
+        used = x | y;
+        break;
+    case 0x6:
+        written = x;
+        return kind_register;
+    case 0x7:
+        written = x;
+        return kind_register;
+    case 0x8:
+        if (n == 0x0)
+        {
+            used = y;
+            written = x;
+            return kind_register;
+        }
+        if (n <= 0x7 || n == 0xE)
+        {
+            used = x | y;
+            written = x | f;
+            return kind_register;
+        }
+        return kind_interpret;
+    case 0x9:
+        used = x | y;
+        break;
+    case 0xA:
+        written = index_bit;
+        return kind_register;
+    case 0xE:
+        if (n != 0xE && n != 0x1)
+        {
+            return kind_interpret;
+        }
+        used = x;
+        break;
+    case 0xF:
+        if ((op & 0xFF) == 0x1E)
+        {
+            used = x;
+            written = index_bit;
+            return kind_register;
+        }
+        if (op == 0xF000 && xo && at + 4 <= size)
+        {
+            written = index_bit;
+            return kind_register;
+        }
+        return kind_interpret;
+    default:
+        return kind_interpret;
+    }
+    // a skip, on xo-chip how far it goes depends on the next instruction, which has to be in the rom to know
+    if (xo && at + 4 > size)
+    {
+        used = 0;
+        return kind_interpret;
+    }
+    return kind_skip;
+}
+
+static void emit_spill(FILE *out, uint32_t registers)
+{
+    for (int r = 0; r < 16; r++)
+    {
+        if (registers & (1 << r))
+        {
+            fprintf(out, "    c->V[%d] = v%x;\n", r, r);
+        }
+    }
+    if (registers & index_bit)
+    {
+        fprintf(out, "    *c->I = i;\n");
+    }
+}
+
+static void emit_reload(FILE *out, uint32_t registers)
+{
+    for (int r = 0; r < 16; r++)
+    {
+        if (registers & (1 << r))
+        {
+            fprintf(out, "    v%x = c->V[%d];\n", r, r);
+        }
+    }
+    if (registers & index_bit)
+    {
+        fprintf(out, "    i = *c->I;\n");
+    }
+}
+
+// hands the instruction at address to the core, the block carries on at next unless the core went somewhere else
+static void emit_interpret(FILE *out, uint16_t address, uint16_t next, uint32_t loaded, uint32_t written)
+{
+    emit_spill(out, written);
+    fprintf(out, "    *c->pc = 0x%03X;\n    c->interpret(c);\n", address);
+    fprintf(out, "    if (c->stop || *c->pc != 0x%03X)\n        return n;\n", next);
+    emit_reload(out, loaded);
+}
+
+// the register work of an instruction classify() called kind_register
+static void emit_register_op(FILE *out, const uint8_t *data, size_t at)
+{
+    uint16_t op = data[at] << 8 | data[at + 1];
+    int x = (op >> 8) & 0xF;
+    int y = (op >> 4) & 0xF;
+    int kk = op & 0xFF;
+    switch (op >> 12)
+    {
+    case 0x6:
+        fprintf(out, "    v%x = 0x%02X;\n", x, kk);
+        return;
+    case 0x7:
+        fprintf(out, "    v%x += 0x%02X;\n", x, kk);
+        return;
+    case 0xA:
+        fprintf(out, "    i = 0x%03X;\n", op & 0xFFF);
+        return;
+    case 0xF:
+        if (op == 0xF000)
+        {
+            fprintf(out, "    i = 0x%04X;\n", data[at + 2] << 8 | data[at + 3]);
+        }
+        else
+        {
+            fprintf(out, "    i += v%x;\n", x);
+        }
+        return;
+    }
+    // 8xyN, in the same order as the core's handlers so x or y being F comes out the same
+    switch (op & 0xF)
+    {
+    case 0x0:
+        fprintf(out, "    v%x = v%x;\n", x, y);
+        break;
+    case 0x1:
+    case 0x2:
+    case 0x3:
+    {
+        static const char *operators[] = {"", "|", "&", "^"};
+        fprintf(out, "    v%x %s= v%x;\n    if (c->vf_reset)\n        vf = 0;\n", x, operators[op & 0xF], y);
+        break;
+    }
+    case 0x4:
+        fprintf(out, "    {\n        unsigned sum = v%x + v%x;\n        v%x = sum;\n        vf = sum > 255;\n    }\n", x, y, x);
+        break;
+    case 0x5:
+        fprintf(out, "    {\n        uint8_t flag = v%x >= v%x;\n        v%x -= v%x;\n        vf = flag;\n    }\n", x, y, x, y);
+        break;
+    case 0x7:
+        fprintf(out, "    {\n        uint8_t flag = v%x >= v%x;\n        v%x = v%x - v%x;\n        vf = flag;\n    }\n", y, x,
+                x, y, x);
+        break;
+    case 0x6:
+        fprintf(out, "    if (c->shift_vy)\n        v%x = v%x;\n", x, y);
+        fprintf(out, "    {\n        uint8_t flag = v%x & 1;\n        v%x >>= 1;\n        vf = flag;\n    }\n", x, x);
+        break;
+    case 0xE:
+        fprintf(out, "    if (c->shift_vy)\n        v%x = v%x;\n", x, y);
+        fprintf(out, "    {\n        uint8_t flag = v%x >> 7;\n        v%x <<= 1;\n        vf = flag;\n    }\n", x, x);
+        break;
+    }
+}
+
+// the condition a skip instruction skips on
+static void format_skip_condition(uint16_t op, char *text, size_t text_size)
+{
+    int x = (op >> 8) & 0xF;
+    int y = (op >> 4) & 0xF;
+    switch (op >> 12)
+    {
+    case 0x3:
+        snprintf(text, text_size, "v%x == 0x%02X", x, op & 0xFF);
+        break;
+    case 0x4:
+        snprintf(text, text_size, "v%x != 0x%02X", x, op & 0xFF);
+        break;
+    case 0x5:
+        snprintf(text, text_size, "v%x == v%x", x, y);
+        break;
+    case 0x9:
+        snprintf(text, text_size, "v%x != v%x", x, y);
+        break;
+    default:
+        snprintf(text, text_size, "c->keypad[v%x & 0xF] %s 0", x, (op & 0xF) == 0xE ? "!=" : "==");
+        break;
+    }
+}
+
+static void write_block(FILE *out, const uint8_t *data, size_t size, chip8::platform_type platform,
+                        const control_flow_graph &graph, const cfg_block &block)
+{
+    const uint16_t base = graph.base;
+    // first the registers the native code touches, they live in locals for the whole block
+    uint32_t loaded = 0;
+    uint32_t written = 0;
+    std::vector<uint16_t> starts;
+    for (uint16_t address = block.begin; address < block.end;)
+    {
+        uint32_t used_here;
+        uint32_t written_here;
+        classify(data, address - base, size, platform, used_here, written_here);
+        loaded |= used_here | written_here;
+        written |= written_here;
+        starts.push_back(address);
+        address += instruction_length(data + address - base, size - (address - base), platform);
+    }
+
+    fprintf(out, "\nstatic int block_%04X(chip8_native_context *c, int budget)\n{\n", block.begin);
+    for (int r = 0; r < 16; r++)
+    {
+        if (loaded & (1 << r))
+        {
+            fprintf(out, "    uint8_t v%x = c->V[%d];\n", r, r);
+        }
+    }
+    if (loaded & index_bit)
+    {
+        fprintf(out, "    uint16_t i = *c->I;\n");
+    }
+    fprintf(out, "    int n = 0;\n");
+    if (starts.size() > 1)
+    {
+        // the dispatcher enters at any instruction, the first one is right below
+        fprintf(out, "    switch (*c->pc)\n    {\n");
+        for (size_t s = 1; s < starts.size(); s++)
+        {
+            fprintf(out, "    case 0x%03X:\n        goto op_%04X;\n", starts[s], starts[s]);
+        }
+        fprintf(out, "    }\n");
+    }
+
+    char text[64];
+    bool open = true;
+    for (size_t s = 0; s < starts.size(); s++)
+    {
+        uint16_t address = starts[s];
+        size_t at = address - base;
+        uint16_t next = s + 1 < starts.size() ? starts[s + 1] : block.end;
+        uint16_t op = at + 2 <= size ? data[at] << 8 | data[at + 1] : 0;
+        uint16_t target = op & 0xFFF;
+        uint32_t used_here;
+        uint32_t written_here;
+        native_kind kind = classify(data, at, size, platform, used_here, written_here);
+        format_instruction(data + at, size - at, platform, text, sizeof(text));
+        fprintf(out, "op_%04X: // %s\n", address, text);
+        fprintf(out, "    if (n == budget)\n    {\n        *c->pc = 0x%03X;\n        goto out;\n    }\n    n++;\n", address);
+        open = true;
+        switch (kind)
+        {
+        case kind_register:
+            emit_register_op(out, data, at);
+            break;
+        case kind_skip:
+        {
+            uint16_t after = next + instruction_length(data + (next - base), size - (next - base), platform);
+            char condition[48];
+            format_skip_condition(op, condition, sizeof(condition));
+            fprintf(out, "    *c->pc = %s ? 0x%03X : 0x%03X;\n    goto out;\n", condition, after, next);
+            open = false;
+            break;
+        }
+        case kind_jump:
+            // jumps to itself (idle) or into the interpreter area (a fault) are left to the core
+            if (target == address || target < 0x200)
+            {
+                emit_interpret(out, address, next, loaded, written);
+            }
+            else if (std::binary_search(starts.begin(), starts.end(), target))
+            {
+                fprintf(out, "    goto op_%04X;\n", target);
+                open = false;
+            }
+            else
+            {
+                fprintf(out, "    *c->pc = 0x%03X;\n    goto out;\n", target);
+                open = false;
+            }
+            break;
+        case kind_call:
+            // a full stack is an overflow fault, the core raises it
+            if (target >= 0x200)
+            {
+                fprintf(out, "    if (*c->sp != 15)\n    {\n        c->stack[*c->sp] = 0x%03X;\n        *c->sp += 1;\n", next);
+                fprintf(out, "        *c->pc = 0x%03X;\n        goto out;\n    }\n", target);
+            }
+            emit_interpret(out, address, next, loaded, written);
+            break;
+        case kind_return:
+            // an empty stack or a return somewhere odd is a fault, the core raises it
+            fprintf(out, "    if (*c->sp != 0 && c->stack[*c->sp - 1] >= 0x200 && c->stack[*c->sp - 1] <= c->address_mask)\n");
+            fprintf(out, "    {\n        *c->sp -= 1;\n        *c->pc = c->stack[*c->sp];\n        goto out;\n    }\n");
+            emit_interpret(out, address, next, loaded, written);
+            break;
+        case kind_interpret:
+            emit_interpret(out, address, next, loaded, written);
+            break;
+        }
+    }
+    if (open)
+    {
+        fprintf(out, "    *c->pc = 0x%03X;\n    goto out;\n", block.end);
+    }
+    fprintf(out, "out:\n");
+    emit_spill(out, written);
+    fprintf(out, "    return n;\n}\n");
+}
+
+// the rom bytes block was compiled from, on xo-chip a skip also depends on how long the instruction it skips is
+static uint16_t compiled_end(const cfg_block &block, size_t size, chip8::platform_type platform, uint16_t base)
+{
+    size_t end = block.end - base;
+    if (platform == chip8::platform_xochip && block.exit == exit_skip)
+    {
+        end += 2;
+    }
+    return base + std::min(end, size);
+}
+
+void write_native_source(FILE *out, const uint8_t *data, size_t size, chip8::platform_type platform, uint64_t hash)
+{
+    control_flow_graph graph;
+    analyze_control_flow(data, size, platform, graph);
+    fprintf(out, "// %zu byte %s rom %016llx, generated by the chip8 recompiler\n\n", size, chip8::platform_name(platform),
+            (unsigned long long)hash);
+    fputs(source_header, out);
+    for (size_t b = 0; b < graph.blocks.size(); b++)
+    {
+        write_block(out, data, size, platform, graph, graph.blocks[b]);
+    }
+
+    fprintf(out, "\nextern \"C\"\n{\n");
+    fprintf(out, "extern const int chip8_native_version = %d;\n", native_abi_version);
+    fprintf(out, "extern const unsigned long long chip8_native_hash = 0x%016llxull;\n", (unsigned long long)hash);
+    fprintf(out, "extern const int chip8_native_platform = %d;\n", platform);
+    fprintf(out, "extern const unsigned chip8_native_size = %zu;\n", size);
+    // an empty array is not C++, an empty rom gets a dummy entry and a count of 0
+    fprintf(out, "extern const native_block_info chip8_native_blocks[] = {\n");
+    for (size_t b = 0; b < graph.blocks.size(); b++)
+    {
+        const cfg_block &block = graph.blocks[b];
+        fprintf(out, "    {0x%03X, 0x%03X, block_%04X},\n", block.begin, compiled_end(block, size, platform, graph.base),
+                block.begin);
+    }
+    fprintf(out, "%s};\n", graph.blocks.empty() ? "    {0, 0, 0},\n" : "");
+    fprintf(out, "extern const unsigned chip8_native_block_count = %zu;\n", graph.blocks.size());
+    fprintf(out, "extern const native_entry chip8_native_entries[] = {\n");
+    size_t entries = 0;
+    for (size_t b = 0; b < graph.blocks.size(); b++)
+    {
+        // no entry where the rest of the block only calls back into the core, the dispatcher interprets those directly,
+        // which matters for the jump to itself most roms idle on
+        const cfg_block &block = graph.blocks[b];
+        std::vector<uint16_t> starts;
+        size_t useful = 0;
+        for (uint16_t address = block.begin; address < block.end;)
+        {
+            size_t at = address - graph.base;
+            uint32_t used;
+            uint32_t written;
+            starts.push_back(address);
+            if (classify(data, at, size, platform, used, written) != kind_interpret)
+            {
+                useful = starts.size();
+            }
+            address += instruction_length(data + at, size - at, platform);
+        }
+        for (size_t s = 0; s < useful; s++, entries++)
+        {
+            fprintf(out, "    {0x%03X, %zu},\n", starts[s], b);
+        }
+    }
+    fprintf(out, "%s};\n", entries == 0 ? "    {0, 0},\n" : "");
+    fprintf(out, "extern const unsigned chip8_native_entry_count = %zu;\n}\n", entries);
+}
+
+native_program::native_program() : begin(0x200), handle(NULL)
+{
+}
+
+native_program::~native_program()
+{
+    if (handle != NULL)
+    {
+        dlclose(handle);
+    }
+}
+
+bool native_program::load(const char *path, uint64_t hash, chip8::platform_type platform)
+{
+    if (handle != NULL)
+    {
+        dlclose(handle);
+    }
+    entries.clear();
+    blocks.clear();
+    compiled.clear();
+    handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (handle == NULL)
+    {
+        return false;
+    }
+    const int *version = (const int *)dlsym(handle, "chip8_native_version");
+    const unsigned long long *rom_hash = (const unsigned long long *)dlsym(handle, "chip8_native_hash");
+    const int *rom_platform = (const int *)dlsym(handle, "chip8_native_platform");
+    const unsigned *size = (const unsigned *)dlsym(handle, "chip8_native_size");
+    const native_block_info *block_table = (const native_block_info *)dlsym(handle, "chip8_native_blocks");
+    const unsigned *block_count = (const unsigned *)dlsym(handle, "chip8_native_block_count");
+    const native_entry *entry_table = (const native_entry *)dlsym(handle, "chip8_native_entries");
+    const unsigned *entry_count = (const unsigned *)dlsym(handle, "chip8_native_entry_count");
+    if (version == NULL || rom_hash == NULL || rom_platform == NULL || size == NULL || block_table == NULL ||
+        block_count == NULL || entry_table == NULL || entry_count == NULL || *version != native_abi_version ||
+        *rom_hash != hash || *rom_platform != platform)
+    {
+        dlclose(handle);
+        handle = NULL;
+        return false;
+    }
+
+    entries.assign(*size, NULL);
+    compiled.assign(*size, 0);
+    for (unsigned b = 0; b < *block_count; b++)
+    {
+        block info = {block_table[b].begin, block_table[b].end, block_table[b].function};
+        blocks.push_back(info);
+        for (uint16_t address = info.begin; address < info.end; address++)
+        {
+            compiled[address - begin] = 1;
+        }
+    }
+    for (unsigned e = 0; e < *entry_count; e++)
+    {
+        entries[entry_table[e].address - begin] = blocks[entry_table[e].block].function;
+    }
+    return true;
+}
+
+std::string native_cache_path(const char *cache_dir, uint64_t hash, chip8::platform_type platform)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "/chip8-%016llx-%s-v%d.so", (unsigned long long)hash, chip8::platform_name(platform),
+             native_abi_version);
+    return cache_dir + std::string(name);
+}
+
+std::shared_ptr<const native_program> load_native(const uint8_t *data, size_t size, chip8::platform_type platform,
+                                                  const char *cache_dir)
+{
+    uint64_t hash = content_hash(data, size);
+    std::string path = native_cache_path(cache_dir, hash, platform);
+    std::shared_ptr<native_program> program = std::make_shared<native_program>();
+    if (access(path.c_str(), R_OK) == 0 && program->load(path.c_str(), hash, platform))
+    {
+        return program;
+    }
+
+    // the pid keeps concurrent compiles of the same rom out of each other's files
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".%d", (int)getpid());
+    std::string source = path + suffix + ".cpp";
+    std::string temporary = path + suffix;
+    FILE *out = fopen(source.c_str(), "w");
+    if (out == NULL)
+    {
+        fprintf(stderr, "could not write %s\n", source.c_str());
+        return std::shared_ptr<const native_program>();
+    }
+    write_native_source(out, data, size, platform, hash);
+    bool written = ferror(out) == 0;
+    written = fclose(out) == 0 && written;
+
+    const char *compiler = getenv("CXX");
+    if (compiler == NULL || compiler[0] == 0)
+    {
+        compiler = "c++";
+    }
+    std::string command = std::string(compiler) + " -std=c++11 -O2 -fPIC -shared -w -o '" + temporary + "' '" + source + "'";
+    bool built = written && system(command.c_str()) == 0;
+    remove(source.c_str());
+    if (!built || rename(temporary.c_str(), path.c_str()) != 0)
+    {
+        fprintf(stderr, "could not compile %s\n", path.c_str());
+        remove(temporary.c_str());
+        return std::shared_ptr<const native_program>();
+    }
+    if (!program->load(path.c_str(), hash, platform))
+    {
+        fprintf(stderr, "could not load %s: %s\n", path.c_str(), dlerror());
+        return std::shared_ptr<const native_program>();
+    }
+    return program;
+}
+
+// mkdir -p, errors show up when the directory gets used
+static void make_directories(const std::string &path)
+{
+    for (size_t slash = path.find('/', 1); slash != std::string::npos; slash = path.find('/', slash + 1))
+    {
+        mkdir(path.substr(0, slash).c_str(), 0755);
+    }
+    mkdir(path.c_str(), 0755);
+}
+
+std::string default_native_cache()
+{
+    std::string path;
+    const char *dir;
+    if ((dir = getenv("CHIP8_CACHE")) != NULL && dir[0] != 0)
+    {
+        path = dir;
+    }
+    else if ((dir = getenv("XDG_CACHE_HOME")) != NULL && dir[0] != 0)
+    {
+        path = std::string(dir) + "/chip8";
+    }
+    else if ((dir = getenv("HOME")) != NULL && dir[0] != 0)
+    {
+        path = std::string(dir) + "/.cache/chip8";
+    }
+    else
+    {
+        path = "/tmp/chip8-cache";
+    }
+    make_directories(path);
+    return path;
+}
@@ -0,0 +1,97 @@
+#ifndef recompiler_h
+#define recompiler_h
+
+#include <cstddef>
+#include <cstdio>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "chip8.hpp"
+
+/* ahead of time recompiler, the rom's recovered control flow graph (see control_flow.hpp) becomes C++ source with one
+function per basic block and the registers in locals, the system compiler builds it into a shared object and dlopen
+loads it, chip8's native engine then runs the blocks and leaves everything they don't cover to predecode
+only register work is translated: loads and arithmetic, Annn, Fx1E, F000 NNNN, the skips (key skips included), jumps,
+calls and returns, anything touching memory, the screen, the timers or the rng calls back into the core for that one
+instruction, so the two can't drift apart on the complicated cases
+the shared object is cached on disk by rom hash, the compiler only runs the first time a rom is seen */
+
+// bump whenever chip8_native_context or the generated code changes, cached objects of any other version are rebuilt
+const int native_abi_version = 1;
+
+// what the generated code sees of a machine, pointers into it rather than copies, the recompiler writes the same struct
+// into every source it generates
+struct chip8_native_context
+{
+    uint8_t *V;
+    uint16_t *I;
+    uint16_t *pc;
+    uint16_t *stack;
+    uint8_t *sp;
+    const unsigned short *keypad;
+    uint16_t address_mask;
+    // the quirks register ops depend on, the others only matter to instructions the core runs
+    uint8_t vf_reset;
+    uint8_t shift_vy;
+    // set by interpret when its instruction raised sound_flag or idle_flag or rewrote compiled code, the block returns
+    uint8_t stop;
+    // runs the instruction at *pc in the core
+    void (*interpret)(chip8_native_context *context);
+    void *machine;
+};
+
+// runs a block from *pc, which can be any instruction in it, for at most budget instructions (at least one), leaves pc
+// at the next instruction and returns how many ran
+typedef int (*chip8_native_block)(chip8_native_context *context, int budget);
+
+// a loaded shared object
+class native_program
+{
+public:
+    struct block
+    {
+        // the rom bytes the block's code was compiled from, a write in here makes it stale
+        uint16_t begin;
+        uint16_t end;
+        chip8_native_block function;
+    };
+
+    native_program();
+    ~native_program();
+
+    // false if the file can't be loaded or was built by another version, for another rom or for another platform
+    bool load(const char *path, uint64_t hash, chip8::platform_type platform);
+
+    // the address entries[0] stands for, always 0x200
+    uint16_t begin;
+    // one per rom byte, the block to call with pc there, NULL where no compiled instruction starts
+    std::vector<chip8_native_block> entries;
+    std::vector<block> blocks;
+    // one per rom byte, set where some block was compiled from it, so writes elsewhere cost a single lookup
+    std::vector<uint8_t> compiled;
+
+private:
+    native_program(const native_program &);
+    native_program &operator=(const native_program &);
+
+    void *handle;
+};
+
+// writes the C++ source for a rom loaded at 0x200 on platform, hash is recorded in it for load() to check
+void write_native_source(FILE *out, const uint8_t *data, size_t size, chip8::platform_type platform, uint64_t hash);
+
+// chip8-HASH-PLATFORM-vABI.so in cache_dir
+std::string native_cache_path(const char *cache_dir, uint64_t hash, chip8::platform_type platform);
+
+/* loads the rom's shared object from cache_dir, compiling it first when it's missing or stale
+the compiler is $CXX, or c++, the source is written next to the object and removed once it built, the object is written
+under a temporary name and renamed into place so two processes compiling the same rom can't load half of one
+NULL with the reason on stderr when compiling or loading fails */
+std::shared_ptr<const native_program> load_native(const uint8_t *data, size_t size, chip8::platform_type platform,
+                                                  const char *cache_dir);
+
+// $CHIP8_CACHE, else $XDG_CACHE_HOME/chip8, else ~/.cache/chip8, else /tmp/chip8-cache, created on the way if needed
+std::string default_native_cache();
+
+#endif
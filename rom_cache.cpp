@@ -0,0 +1,86 @@
+#include "rom_cache.hpp"
+#include <map>
+#include <mutex>
+#include <string>
+#include <sys/stat.h>
+#include <unordered_map>
+
+uint64_t content_hash(const uint8_t *data, size_t size)
+{
+    uint64_t hash = 0xCBF29CE484222325ull;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= data[i];
+        hash *= 0x100000001B3ull;
+    }
+    return hash;
+}
+
+// a path is only trusted to still hold the same rom while its size and modification time are unchanged
+struct path_entry
+{
+    off_t size;
+    time_t mtime;
+    uint64_t hash;
+};
+
+static std::mutex cache_mutex;
+static std::unordered_map<std::string, path_entry> paths;
+// the same bytes load differently per platform (memory size, decode tables), so each gets its own image
+typedef std::pair<uint64_t, int> image_key;
+static std::map<image_key, std::shared_ptr<const rom_image> > images;
+
+std::shared_ptr<const rom_image> load_rom_image(const char *filename, chip8::platform_type platform)
+{
+    off_t limit = (platform == chip8::platform_xochip ? 0x10000 : 0x1000) - 0x200;
+    struct stat info;
+    if (stat(filename, &info) != 0 || info.st_size > limit)
+    {
+        return std::shared_ptr<const rom_image>();
+    }
+
+    std::lock_guard<std::mutex> lock(cache_mutex);
+
+    // fast path, the path was seen before and the file hasn't changed, no need to map or hash it again
+    std::unordered_map<std::string, path_entry>::iterator seen = paths.find(filename);
+    if (seen != paths.end() && seen->second.size == info.st_size && seen->second.mtime == info.st_mtime)
+    {
+        std::map<image_key, std::shared_ptr<const rom_image> >::iterator image =
+            images.find(image_key(seen->second.hash, platform));
+        if (image != images.end())
+        {
+            return image->second;
+        }
+    }
+
+    std::shared_ptr<rom_image> image = std::make_shared<rom_image>();
+    if (!image->file.open(filename) || image->file.size() > (size_t)limit)
+    {
+        return std::shared_ptr<const rom_image>();
+    }
+
+    uint64_t hash = content_hash(image->file.data(), image->file.size());
+    path_entry entry = {info.st_size, info.st_mtime, hash};
+    paths[filename] = entry;
+
+    // same contents under another path, keep the image we already have
+    std::map<image_key, std::shared_ptr<const rom_image> >::iterator existing = images.find(image_key(hash, platform));
+    if (existing != images.end())
+    {
+        return existing->second;
+    }
+
+    image->hash = hash;
+    image->platform = platform;
+    image->prototype.set_platform(platform);
+    image->prototype.load_bytes(image->file.data(), image->file.size());
+    image->prototype.predecode();
+    images[image_key(hash, platform)] = image;
+    return image;
+}
+
+bool load_shared(chip8 &cpu, const char *filename)
+{
+    std::shared_ptr<const rom_image> image = load_rom_image(filename, cpu.platform());
+    return image && cpu.share_rom(image->prototype);
+}
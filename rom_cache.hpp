@@ -0,0 +1,44 @@
+#ifndef rom_cache_h
+#define rom_cache_h
+
+#include <cstddef>
+#include <memory>
+#include <stdint.h>
+#include "chip8.hpp"
+#include "mapped_file.hpp"
+
+/* process wide cache of loaded roms
+each rom file is mmap'd and hashed once, images are keyed by content hash and platform so the same rom under two paths
+is still one image, and every instance started from an image shares its memory pages and predecoded instruction table
+until it writes into them
+safe to call from several threads */
+
+// 64 bit fnv-1a over the rom bytes, the key used for the cache and anything else that identifies a rom by content
+uint64_t content_hash(const uint8_t *data, size_t size);
+
+struct rom_image
+{
+    uint64_t hash;
+    chip8::platform_type platform;
+    // the read only mapping of the file, kept for the image's lifetime
+    mapped_file file;
+    // an instance with the rom loaded and predecoded, start new instances from it with share_rom() or by copying it
+    chip8 prototype;
+
+    rom_image() : hash(0), platform(chip8::platform_chip8) {}
+
+private:
+    rom_image(const rom_image &);
+    rom_image &operator=(const rom_image &);
+};
+
+// returns the cached image of filename loaded on platform, loading it on first use, NULL if the file can't be read or
+// doesn't fit in that platform's memory
+std::shared_ptr<const rom_image> load_rom_image(const char *filename,
+                                                chip8::platform_type platform = chip8::platform_chip8);
+
+// points cpu at the cached image for filename on cpu's current platform, the equivalent of cpu.load_file() that only
+// touches the disk once per rom
+bool load_shared(chip8 &cpu, const char *filename);
+
+#endif
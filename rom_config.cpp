@@ -0,0 +1,241 @@
+#include "rom_config.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+rom_settings::rom_settings()
+    : ipf(0), max_ipf(0), adaptive(-1), quirks(NULL), platform(chip8::platform_count), engine(chip8::engine_count),
+      palette_size(0)
+{
+}
+
+// strips leading and trailing whitespace in place
+static char *trim(char *text)
+{
+    while (isspace((unsigned char)*text))
+    {
+        text++;
+    }
+    char *end = text + strlen(text);
+    while (end > text && isspace((unsigned char)end[-1]))
+    {
+        *--end = 0;
+    }
+    return text;
+}
+
+// a whole decimal number, at least 1
+static bool parse_count(const char *value, int &out)
+{
+    char *end;
+    long number = strtol(value, &end, 10);
+    if (end == value || *end != 0 || number < 1 || number > 1000000)
+    {
+        return false;
+    }
+    out = (int)number;
+    return true;
+}
+
+static bool parse_palette(char *value, rom_settings &settings)
+{
+    uint32_t colors[16];
+    int count = 0;
+    for (char *color = strtok(value, " \t,"); color != NULL; color = strtok(NULL, " \t,"))
+    {
+        if (color[0] == '#')
+        {
+            color++;
+        }
+        char *end;
+        unsigned long rgb = strtoul(color, &end, 16);
+        if (count == 16 || strlen(color) != 6 || *end != 0)
+        {
+            return false;
+        }
+        colors[count++] = 0xFF000000 | (uint32_t)rgb;
+    }
+    if (count == 0)
+    {
+        return false;
+    }
+    memcpy(settings.palette, colors, sizeof(colors[0]) * count);
+    settings.palette_size = count;
+    return true;
+}
+
+// applies one key, false if the key is unknown or its value doesn't parse
+static bool parse_setting(const char *key, char *value, rom_settings &settings)
+{
+    if (strcmp(key, "name") == 0)
+    {
+        settings.name = value;
+        return true;
+    }
+    if (strcmp(key, "ipf") == 0)
+    {
+        return parse_count(value, settings.ipf);
+    }
+    if (strcmp(key, "max_ipf") == 0)
+    {
+        return parse_count(value, settings.max_ipf);
+    }
+    if (strcmp(key, "adaptive") == 0)
+    {
+        if (strcmp(value, "yes") == 0 || strcmp(value, "true") == 0 || strcmp(value, "1") == 0)
+        {
+            settings.adaptive = 1;
+        }
+        else if (strcmp(value, "no") == 0 || strcmp(value, "false") == 0 || strcmp(value, "0") == 0)
+        {
+            settings.adaptive = 0;
+        }
+        else
+        {
+            return false;
+        }
+        return true;
+    }
+    if (strcmp(key, "quirks") == 0)
+    {
+        settings.quirks = chip8::find_quirks(value);
+        return settings.quirks != NULL;
+    }
+    if (strcmp(key, "platform") == 0)
+    {
+        settings.platform = chip8::find_platform(value);
+        return settings.platform != chip8::platform_count;
+    }
+    if (strcmp(key, "engine") == 0)
+    {
+        for (settings.engine = 0; settings.engine < chip8::engine_count; settings.engine++)
+        {
+            if (strcmp(chip8::engine_name(settings.engine), value) == 0)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+    if (strcmp(key, "keymap") == 0)
+    {
+        if (strlen(value) != 16)
+        {
+            return false;
+        }
+        for (int i = 0; i < 16; i++)
+        {
+            if (!isgraph((unsigned char)value[i]))
+            {
+                return false;
+            }
+            value[i] = tolower((unsigned char)value[i]);
+        }
+        settings.keymap = value;
+        return true;
+    }
+    if (strcmp(key, "palette") == 0)
+    {
+        return parse_palette(value, settings);
+    }
+    return false;
+}
+
+// line number of the byte at offset, for error messages
+static int line_at(const char *text, size_t offset)
+{
+    return 1 + (int)std::count(text, text + offset, '\n');
+}
+
+bool rom_config::load(const char *filename)
+{
+    sections.clear();
+    this->filename = filename;
+    if (!file.open(filename))
+    {
+        return false;
+    }
+    const char *text = (const char *)file.data();
+    size_t size = file.size();
+    // only section headers are looked at here, a [ that starts a line after any indentation, found with memchr rather
+    // than walking every line
+    for (const char *bracket = text; (bracket = (const char *)memchr(bracket, '[', text + size - bracket)) != NULL;)
+    {
+        size_t at = bracket - text;
+        bracket++;
+        size_t start = at;
+        while (start > 0 && (text[start - 1] == ' ' || text[start - 1] == '\t'))
+        {
+            start--;
+        }
+        if (start > 0 && text[start - 1] != '\n')
+        {
+            continue;
+        }
+        const char *end = (const char *)memchr(text + at, '\n', size - at);
+        size_t next = end != NULL ? end - text + 1 : size;
+        // the hash and closing bracket, copied out since the mapping isn't nul terminated
+        char header[32];
+        size_t length = std::min(next - at, sizeof(header) - 1);
+        memcpy(header, text + at, length);
+        header[length] = 0;
+        char *digits_end;
+        uint64_t hash = strtoull(header + 1, &digits_end, 16);
+        if (digits_end == header + 1 || *digits_end != ']' || *trim(digits_end + 1) != 0)
+        {
+            fprintf(stderr, "%s:%d: expected [content hash]\n", filename, line_at(text, at));
+            continue;
+        }
+        sections[hash] = next;
+    }
+    return true;
+}
+
+bool rom_config::find(uint64_t hash, rom_settings &settings) const
+{
+    std::unordered_map<uint64_t, size_t>::const_iterator found = sections.find(hash);
+    if (found == sections.end())
+    {
+        return false;
+    }
+    settings = rom_settings();
+    const char *text = (const char *)file.data();
+    size_t size = file.size();
+    for (size_t at = found->second; at < size;)
+    {
+        const char *end = (const char *)memchr(text + at, '\n', size - at);
+        size_t next = end != NULL ? end - text + 1 : size;
+        char line[4096];
+        size_t length = std::min(next - at, sizeof(line) - 1);
+        memcpy(line, text + at, length);
+        line[length] = 0;
+        size_t start = at;
+        at = next;
+
+        char *key = trim(line);
+        if (key[0] == 0 || key[0] == ';' || key[0] == '#')
+        {
+            continue;
+        }
+        // the next section ends this one
+        if (key[0] == '[')
+        {
+            break;
+        }
+        char *equals = strchr(key, '=');
+        if (equals == NULL)
+        {
+            fprintf(stderr, "%s:%d: expected key = value\n", filename.c_str(), line_at(text, start));
+            continue;
+        }
+        *equals = 0;
+        key = trim(key);
+        if (!parse_setting(key, trim(equals + 1), settings))
+        {
+            fprintf(stderr, "%s:%d: bad setting %s\n", filename.c_str(), line_at(text, start), key);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,75 @@
+#ifndef rom_config_h
+#define rom_config_h
+
+#include <cstddef>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include "chip8.hpp"
+#include "mapped_file.hpp"
+
+/* per rom settings, read from an ini file with one section per rom keyed by its content hash (content_hash() in
+rom_cache.hpp, the same 16 hex digits romlib lists), for example
+
+    ; lines starting with ; or # are comments
+    [1b5c8a4c2d0e3f97]
+    name = BRIX
+    ipf = 15
+    adaptive = yes
+    max_ipf = 200
+    quirks = schip
+    platform = chip8
+    engine = predecode
+    keymap = x123qweasdzc4rfv
+    palette = 000000 ffffff aaaaaa 555555
+
+every key is optional, whatever a section leaves out falls back to the command line or the built in default
+keymap is sixteen characters, the keyboard key for chip8 keys 0 to F, palette up to sixteen rrggbb colors, one per
+xo-chip color index starting at 0
+loading maps the file and indexes where each section starts in a hash table, only the section of the rom being run is
+ever parsed, a file with 5000 roms loads in a millisecond or two, nothing next to opening a window */
+
+struct rom_settings
+{
+    // free text for whoever edits the file, unused otherwise
+    std::string name;
+    // 0 when not set
+    int ipf;
+    int max_ipf;
+    // -1 when not set, otherwise 0 or 1
+    int adaptive;
+    // NULL when not set
+    const quirk_profile *quirks;
+    // platform_count when not set
+    chip8::platform_type platform;
+    // engine_count when not set
+    int engine;
+    // empty when not set
+    std::string keymap;
+    // argb, the first palette_size entries are set
+    uint32_t palette[16];
+    int palette_size;
+
+    rom_settings();
+};
+
+class rom_config
+{
+public:
+    // false if the file can't be read
+    bool load(const char *filename);
+
+    // parses the rom's section into settings, false when the file has none, bad lines in it are reported on stderr with
+    // their line number and skipped
+    bool find(uint64_t hash, rom_settings &settings) const;
+
+    size_t size() const { return sections.size(); }
+
+private:
+    std::string filename;
+    mapped_file file;
+    // where the line after each section header starts, a repeated section replaces the earlier one
+    std::unordered_map<uint64_t, size_t> sections;
+};
+
+#endif
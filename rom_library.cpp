@@ -0,0 +1,283 @@
+#include "rom_library.hpp"
+#include "mapped_file.hpp"
+#include "rom_cache.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <cstring>
+#include <dirent.h>
+#include <sys/stat.h>
+
+std::vector<std::string> list_rom_files(const char *directory)
+{
+    std::vector<std::string> files;
+    DIR *listing = opendir(directory);
+    if (listing == NULL)
+    {
+        return files;
+    }
+    struct dirent *item;
+    while ((item = readdir(listing)) != NULL)
+    {
+        if (item->d_name[0] == '.')
+        {
+            continue;
+        }
+        std::string path = std::string(directory) + "/" + item->d_name;
+        struct stat info;
+        if (stat(path.c_str(), &info) == 0 && S_ISREG(info.st_mode))
+        {
+            files.push_back(path);
+        }
+    }
+    closedir(listing);
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+// classifies one instruction, 2 for xochip only opcodes, 1 for super-chip ones, 0 otherwise
+static int extension_level(uint16_t op)
+{
+    if (op == 0xF000 || op == 0xF002 || (op & 0xF0FF) == 0xF03A || (op & 0xF0FF) == 0xF001)
+    {
+        return 2;
+    }
+    if ((op & 0xF00F) == 0x5002 || (op & 0xF00F) == 0x5003)
+    {
+        return 2;
+    }
+    if (op == 0x00FB || op == 0x00FC || op == 0x00FD || op == 0x00FE || op == 0x00FF || (op & 0xFFF0) == 0x00C0)
+    {
+        return 1;
+    }
+    if ((op & 0xF0FF) == 0xF030 || (op & 0xF0FF) == 0xF075 || (op & 0xF0FF) == 0xF085)
+    {
+        return 1;
+    }
+    return 0;
+}
+
+const char *detect_platform(const uint8_t *data, size_t size)
+{
+    // only instructions reachable from 0x200 count, sprite data is full of byte pairs that look like extension opcodes
+    // the walk follows jumps, calls and both sides of skips, and stops at returns, Bnnn and anything outside the rom
+    std::vector<bool> visited(size, false);
+    std::vector<size_t> pending(1, 0);
+    int level = 0;
+    while (!pending.empty())
+    {
+        size_t at = pending.back();
+        pending.pop_back();
+        while (at + 1 < size && !visited[at])
+        {
+            visited[at] = true;
+            uint16_t op = data[at] << 8 | data[at + 1];
+            int found = extension_level(op);
+            level = found > level ? found : level;
+            size_t next = at + 2;
+            // xochip's long load is four bytes long
+            if (op == 0xF000)
+            {
+                next += 2;
+            }
+            uint16_t target = op & 0x0FFF;
+            switch (op >> 12)
+            {
+            case 0x0:
+                if (op == 0x00EE || op == 0x00FD)
+                {
+                    next = size;
+                }
+                break;
+            case 0x1:
+                next = target >= 0x200 ? target - 0x200 : size;
+                break;
+            case 0x2:
+                if (target >= 0x200)
+                {
+                    pending.push_back(target - 0x200);
+                }
+                break;
+            case 0x3:
+            case 0x4:
+            case 0x5:
+            case 0x9:
+                pending.push_back(next + 2);
+                break;
+            case 0xB:
+                next = size;
+                break;
+            case 0xE:
+                if ((op & 0xFF) == 0x9E || (op & 0xFF) == 0xA1)
+                {
+                    pending.push_back(next + 2);
+                }
+                break;
+            }
+            at = next;
+        }
+    }
+    return level == 2 ? "xochip" : level == 1 ? "schip" : "chip8";
+}
+
+const char *default_quirks(const char *platform)
+{
+    return strcmp(platform, "chip8") == 0 ? "default" : platform;
+}
+
+rom_library::rom_library() : dirty(false) {}
+
+bool rom_library::load(const char *filename)
+{
+    index_file = filename;
+    entries.clear();
+    by_path.clear();
+    by_hash.clear();
+    dirty = false;
+
+    FILE *file = fopen(filename, "r");
+    if (file == NULL)
+    {
+        return true;
+    }
+    char line[4096];
+    while (fgets(line, sizeof(line), file))
+    {
+        if (line[0] == '#' || line[0] == '\n')
+        {
+            continue;
+        }
+        line[strcspn(line, "\n")] = 0;
+        // hash, size, mtime, platform, quirks, path
+        char *fields[6];
+        char *cursor = line;
+        int count = 0;
+        for (; count < 6 && cursor != NULL; count++)
+        {
+            fields[count] = cursor;
+            cursor = count < 5 ? strchr(cursor, '\t') : NULL;
+            if (cursor != NULL)
+            {
+                *cursor++ = 0;
+            }
+        }
+        if (count < 6)
+        {
+            continue;
+        }
+        rom_entry entry;
+        entry.hash = strtoull(fields[0], NULL, 16);
+        entry.size = strtoull(fields[1], NULL, 10);
+        entry.mtime = strtoll(fields[2], NULL, 10);
+        entry.platform = fields[3];
+        entry.quirks = fields[4];
+        entry.path = fields[5];
+        // older indexes copied the platform into the quirks column, which sent plain roms to the vip profile
+        if (entry.platform == "chip8" && entry.quirks == "chip8")
+        {
+            entry.quirks = default_quirks("chip8");
+            dirty = true;
+        }
+        by_path[entry.path] = entries.size();
+        by_hash[entry.hash] = entries.size();
+        entries.push_back(entry);
+    }
+    fclose(file);
+    return true;
+}
+
+bool rom_library::save()
+{
+    if (!dirty || index_file.empty())
+    {
+        return true;
+    }
+    std::string temporary = index_file + ".tmp";
+    FILE *file = fopen(temporary.c_str(), "w");
+    if (file == NULL)
+    {
+        return false;
+    }
+    fprintf(file, "# chip8 rom library: hash\tsize\tmtime\tplatform\tquirks\tpath\n");
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        const rom_entry &entry = entries[i];
+        fprintf(file, "%016llx\t%zu\t%lld\t%s\t%s\t%s\n", (unsigned long long)entry.hash, entry.size,
+                (long long)entry.mtime, entry.platform.c_str(), entry.quirks.c_str(), entry.path.c_str());
+    }
+    if (fclose(file) != 0 || rename(temporary.c_str(), index_file.c_str()) != 0)
+    {
+        return false;
+    }
+    dirty = false;
+    return true;
+}
+
+const rom_entry *rom_library::scan(const char *path)
+{
+    struct stat info;
+    if (stat(path, &info) != 0)
+    {
+        return NULL;
+    }
+
+    std::unordered_map<std::string, size_t>::iterator seen = by_path.find(path);
+    if (seen != by_path.end())
+    {
+        rom_entry &entry = entries[seen->second];
+        if (entry.size == (size_t)info.st_size && entry.mtime == info.st_mtime)
+        {
+            return &entry;
+        }
+    }
+
+    mapped_file file;
+    if (!file.open(path))
+    {
+        return NULL;
+    }
+
+    rom_entry entry;
+    entry.hash = content_hash(file.data(), file.size());
+    entry.size = file.size();
+    entry.mtime = file.mtime();
+    entry.path = path;
+    // a copy of a rom that is already indexed under another path reuses its analysis
+    std::unordered_map<uint64_t, size_t>::iterator same = by_hash.find(entry.hash);
+    if (same != by_hash.end())
+    {
+        entry.platform = entries[same->second].platform;
+        entry.quirks = entries[same->second].quirks;
+    }
+    else
+    {
+        entry.platform = detect_platform(file.data(), file.size());
+        entry.quirks = default_quirks(entry.platform.c_str());
+    }
+
+    size_t index = seen != by_path.end() ? seen->second : entries.size();
+    if (index == entries.size())
+    {
+        entries.push_back(entry);
+        by_path[entry.path] = index;
+    }
+    else
+    {
+        // the file at this path changed, its old contents are no longer indexed anywhere
+        std::unordered_map<uint64_t, size_t>::iterator old = by_hash.find(entries[index].hash);
+        if (old != by_hash.end() && old->second == index)
+        {
+            by_hash.erase(old);
+        }
+        entries[index] = entry;
+    }
+    by_hash[entry.hash] = index;
+    dirty = true;
+    return &entries[index];
+}
+
+const rom_entry *rom_library::find(uint64_t hash) const
+{
+    std::unordered_map<uint64_t, size_t>::const_iterator found = by_hash.find(hash);
+    return found != by_hash.end() ? &entries[found->second] : NULL;
+}
@@ -0,0 +1,62 @@
+#ifndef rom_library_h
+#define rom_library_h
+
+#include <cstddef>
+#include <ctime>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/* content addressed index of a rom collection, persisted as a tab separated text file
+each entry records the rom's content hash, size, modification time, detected platform and quirk profile, so a later run only
+re-reads files whose size or mtime changed */
+
+struct rom_entry
+{
+    uint64_t hash;
+    size_t size;
+    time_t mtime;
+    // "chip8", "schip" or "xochip", guessed from the opcodes the rom uses
+    std::string platform;
+    // name of the quirk profile to run it with, see default_quirks()
+    std::string quirks;
+    std::string path;
+};
+
+// regular files directly inside directory (not recursive, dot files skipped), sorted by name
+std::vector<std::string> list_rom_files(const char *directory);
+
+// guesses the platform by scanning the rom for opcodes only SUPER-CHIP or XO-CHIP define
+const char *detect_platform(const uint8_t *data, size_t size);
+
+// the quirk profile a rom of a detected platform starts with: plain chip8 roms get "default", what the core runs when
+// nobody picks a profile, super-chip and xo-chip roms get the profile of the same name
+const char *default_quirks(const char *platform);
+
+class rom_library
+{
+public:
+    rom_library();
+
+    // reads an index written by save(), a missing file is an empty library
+    bool load(const char *filename);
+    // writes the index back if anything changed, through a temporary file so a crash never leaves half an index
+    bool save();
+
+    // entry for the rom at path, hashed and analysed only when the path is new or the file changed, NULL if unreadable
+    const rom_entry *scan(const char *path);
+    const rom_entry *find(uint64_t hash) const;
+
+    size_t size() const { return entries.size(); }
+    const rom_entry &operator[](size_t index) const { return entries[index]; }
+
+private:
+    std::string index_file;
+    std::vector<rom_entry> entries;
+    std::unordered_map<std::string, size_t> by_path;
+    std::unordered_map<uint64_t, size_t> by_hash;
+    bool dirty;
+};
+
+#endif
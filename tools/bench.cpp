@@ -0,0 +1,259 @@
+#include "../chip8.hpp"
+#include "../frame_timing.hpp"
+#include "../headless.hpp"
+#include "../recompiler.hpp"
+#include "../rom_cache.hpp"
+#include "../rom_library.hpp"
+#include "bench.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// whole rom benchmark, runs every rom headless for a fixed instruction budget under scripted input and reports
+// instructions/s, frames/s and ns/instruction with their spread over repetitions
+// usage: bench [--instructions N] [--repetitions N] [--ipf N] [--engine NAME|all] [--quirks NAME|all] [--json FILE]
+//              [--baseline FILE [--tolerance PERCENT] [--significance P]] [PATH...]
+// without paths it runs roms/ and the .ch8 files in the current directory
+// with --baseline the results are checked against an earlier --json file and the exit status is 1 if anything regressed
+
+std::string base_name(const std::string &path)
+{
+    size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+void write_json_string(FILE *out, const std::string &text)
+{
+    fputc('"', out);
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        if (text[i] == '"' || text[i] == '\\')
+        {
+            fputc('\\', out);
+        }
+        fputc(text[i], out);
+    }
+    fputc('"', out);
+}
+
+void write_json(FILE *out, const std::vector<bench_result> &results, uint64_t instructions, int ipf)
+{
+    fprintf(out, "{\n  \"instructions\": %llu,\n  \"ipf\": %d,\n  \"results\": [\n", (unsigned long long)instructions, ipf);
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const bench_result &r = results[i];
+        fprintf(out, "    {\"rom\": ");
+        write_json_string(out, r.rom);
+        fprintf(out, ", \"engine\": ");
+        write_json_string(out, r.engine);
+        fprintf(out, ", \"quirks\": ");
+        write_json_string(out, r.quirks);
+        fprintf(out, ", \"ns_per_instruction\": %.4f, \"stddev\": %.4f, \"mips\": %.3f, \"fps\": %.1f, \"samples\": [",
+                r.mean, r.stddev, 1e3 / r.mean, 1e9 / (r.mean * ipf));
+        for (size_t j = 0; j < r.samples.size(); j++)
+        {
+            fprintf(out, "%s%.4f", j ? ", " : "", r.samples[j]);
+        }
+        fprintf(out, "]}%s\n", i + 1 < results.size() ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+int main(int argc, char *argv[])
+{
+    uint64_t instructions = 1000000;
+    int repetitions = 5;
+    int ipf = 10;
+    const char *engine_choice = "all";
+    const char *quirk_choice = "default";
+    const char *json_file = NULL;
+    const char *baseline_file = NULL;
+    double tolerance = 5.0;
+    double significance = 0.01;
+    std::vector<std::string> roms;
+
+    for (int i = 1; i < argc; i++)
+    {
+        bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--instructions") == 0 && has_value)
+        {
+            instructions = strtoull(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--repetitions") == 0 && has_value)
+        {
+            repetitions = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--ipf") == 0 && has_value)
+        {
+            ipf = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--engine") == 0 && has_value)
+        {
+            engine_choice = argv[++i];
+        }
+        else if (strcmp(argv[i], "--quirks") == 0 && has_value)
+        {
+            quirk_choice = argv[++i];
+        }
+        else if (strcmp(argv[i], "--json") == 0 && has_value)
+        {
+            json_file = argv[++i];
+        }
+        else if (strcmp(argv[i], "--baseline") == 0 && has_value)
+        {
+            baseline_file = argv[++i];
+        }
+        else if (strcmp(argv[i], "--tolerance") == 0 && has_value)
+        {
+            tolerance = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--significance") == 0 && has_value)
+        {
+            significance = atof(argv[++i]);
+        }
+        else if (argv[i][0] == '-')
+        {
+            fprintf(stderr, "usage: %s [--instructions N] [--repetitions N] [--ipf N] [--engine NAME|all] "
+                            "[--quirks NAME|all] [--json FILE] [--baseline FILE [--tolerance PERCENT] "
+                            "[--significance P]] [PATH...]\n",
+                    argv[0]);
+            exit(1);
+        }
+        else
+        {
+            std::vector<std::string> files = list_rom_files(argv[i]);
+            if (files.empty())
+            {
+                files.push_back(argv[i]);
+            }
+            roms.insert(roms.end(), files.begin(), files.end());
+        }
+    }
+    if (roms.empty())
+    {
+        roms = list_rom_files("roms");
+        std::vector<std::string> top = list_rom_files(".");
+        for (size_t i = 0; i < top.size(); i++)
+        {
+            if (top[i].size() > 4 && top[i].compare(top[i].size() - 4, 4, ".ch8") == 0)
+            {
+                roms.push_back(top[i]);
+            }
+        }
+    }
+    if (repetitions < 1 || ipf < 1)
+    {
+        fprintf(stderr, "repetitions and ipf must be positive\n");
+        exit(1);
+    }
+
+    // read the baseline up front, a typo in its name shouldn't cost a whole benchmark run
+    std::vector<bench_result> baseline;
+    if (baseline_file != NULL && !read_bench_json(baseline_file, baseline))
+    {
+        fprintf(stderr, "could not read baseline %s\n", baseline_file);
+        exit(1);
+    }
+
+    std::vector<int> engines;
+    for (int e = 0; e < chip8::engine_count; e++)
+    {
+        if (strcmp(engine_choice, "all") == 0 || strcmp(engine_choice, chip8::engine_name(e)) == 0)
+        {
+            engines.push_back(e);
+        }
+    }
+    std::vector<const quirk_profile *> profiles;
+    for (const quirk_profile *p = chip8::quirk_profiles(); p->name != NULL; p++)
+    {
+        if (strcmp(quirk_choice, "all") == 0 || strcmp(quirk_choice, p->name) == 0)
+        {
+            profiles.push_back(p);
+        }
+    }
+    if (engines.empty() || profiles.empty())
+    {
+        fprintf(stderr, "no engine or quirk profile matches\n");
+        exit(1);
+    }
+
+    headless_options options;
+    options.ipf = ipf;
+    options.frames = (uint32_t)((instructions + ipf - 1) / ipf);
+    options.input = scripted_input(options.frames, 1);
+    uint64_t executed = (uint64_t)options.frames * ipf;
+
+    std::vector<bench_result> results;
+    printf("%-16s %-10s %-8s %10s %8s %10s %12s\n", "rom", "engine", "quirks", "ns/instr", "+-", "MIPS", "frames/s");
+    for (size_t r = 0; r < roms.size(); r++)
+    {
+        // read, hashed and predecoded once, every repetition below starts from this image
+        std::shared_ptr<const rom_image> image = load_rom_image(roms[r].c_str());
+        if (!image)
+        {
+            fprintf(stderr, "skipping %s, could not load\n", roms[r].c_str());
+            continue;
+        }
+        // compiled on the first run and loaded from the cache after that, either way outside the timing
+        std::shared_ptr<const native_program> program;
+        if (std::find(engines.begin(), engines.end(), (int)chip8::engine_native) != engines.end())
+        {
+            program = load_native(image->file.data(), image->file.size(), image->platform,
+                                  default_native_cache().c_str());
+        }
+        for (size_t e = 0; e < engines.size(); e++)
+        {
+            for (size_t q = 0; q < profiles.size(); q++)
+            {
+                bench_result result;
+                result.rom = base_name(roms[r]);
+                result.engine = chip8::engine_name(engines[e]);
+                result.quirks = profiles[q]->name;
+                for (int rep = 0; rep < repetitions; rep++)
+                {
+                    // every repetition is a fresh instance sharing the image's pages, setup stays outside the timing
+                    chip8 cpu;
+                    cpu.seed(1);
+                    cpu.share_rom(image->prototype);
+                    cpu.set_engine((chip8::engine_type)engines[e]);
+                    if (engines[e] == chip8::engine_native)
+                    {
+                        cpu.set_native(program);
+                    }
+                    cpu.set_quirks(*profiles[q]);
+                    uint64_t start = now_ns();
+                    run_headless(cpu, options);
+                    result.samples.push_back((double)(now_ns() - start) / executed);
+                }
+                summarize(result);
+                printf("%-16s %-10s %-8s %10.2f %8.2f %10.2f %12.0f\n", result.rom.c_str(), result.engine.c_str(),
+                       result.quirks.c_str(), result.mean, result.stddev, 1e3 / result.mean, 1e9 / (result.mean * ipf));
+                results.push_back(result);
+            }
+        }
+    }
+
+    if (json_file != NULL)
+    {
+        FILE *out = strcmp(json_file, "-") == 0 ? stdout : fopen(json_file, "w");
+        if (out == NULL)
+        {
+            fprintf(stderr, "could not write %s\n", json_file);
+            exit(1);
+        }
+        write_json(out, results, executed, ipf);
+        if (out != stdout)
+        {
+            fclose(out);
+        }
+    }
+
+    if (baseline_file != NULL && compare_to_baseline(baseline, results, tolerance, significance, stdout) > 0)
+    {
+        return 1;
+    }
+    return 0;
+}
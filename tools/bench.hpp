@@ -0,0 +1,37 @@
+#ifndef bench_h
+#define bench_h
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// shared between the benchmark runner and the baseline comparison
+
+struct bench_result
+{
+    std::string rom;
+    std::string engine;
+    std::string quirks;
+    // ns per instruction, one sample per repetition
+    std::vector<double> samples;
+    double mean;
+    double stddev;
+    // allowed slowdown in percent before this entry counts as a regression, negative means use the command line default
+    double tolerance;
+
+    bench_result() : mean(0), stddev(0), tolerance(-1) {}
+};
+
+void summarize(bench_result &result);
+
+// reads a results file written by bench --json, entries may carry their own "tolerance"
+bool read_bench_json(const char *filename, std::vector<bench_result> &results);
+
+/* compares current results against a baseline, entry by entry (rom, engine, quirks)
+an entry regresses when it is slower than the baseline by more than its tolerance and a one-sided welch t-test over the
+repetition samples says the slowdown is significant at the given level, so noisy runs need a real shift to fail
+prints a table and returns the number of regressions */
+int compare_to_baseline(const std::vector<bench_result> &baseline, const std::vector<bench_result> &current,
+                        double default_tolerance, double significance, FILE *out);
+
+#endif
@@ -0,0 +1,372 @@
+#include "bench.hpp"
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+void summarize(bench_result &result)
+{
+    double sum = 0;
+    for (size_t i = 0; i < result.samples.size(); i++)
+    {
+        sum += result.samples[i];
+    }
+    result.mean = result.samples.empty() ? 0.0 : sum / result.samples.size();
+    double squares = 0;
+    for (size_t i = 0; i < result.samples.size(); i++)
+    {
+        squares += (result.samples[i] - result.mean) * (result.samples[i] - result.mean);
+    }
+    result.stddev = result.samples.size() > 1 ? sqrt(squares / (result.samples.size() - 1)) : 0.0;
+}
+
+// just enough json to read back what bench writes: objects, arrays, strings, numbers, true/false/null
+class json_reader
+{
+public:
+    explicit json_reader(const std::string &text) : text(text), at(0) {}
+
+    bool read_results(std::vector<bench_result> &results)
+    {
+        if (!expect('{'))
+        {
+            return false;
+        }
+        while (!peek('}'))
+        {
+            std::string key;
+            if (!read_string(key) || !expect(':'))
+            {
+                return false;
+            }
+            if (key == "results")
+            {
+                if (!read_entries(results))
+                {
+                    return false;
+                }
+            }
+            else if (!skip_value())
+            {
+                return false;
+            }
+            if (!peek('}') && !expect(','))
+            {
+                return false;
+            }
+        }
+        return expect('}');
+    }
+
+private:
+    bool read_entries(std::vector<bench_result> &results)
+    {
+        if (!expect('['))
+        {
+            return false;
+        }
+        while (!peek(']'))
+        {
+            bench_result result;
+            if (!expect('{'))
+            {
+                return false;
+            }
+            while (!peek('}'))
+            {
+                std::string key;
+                if (!read_string(key) || !expect(':'))
+                {
+                    return false;
+                }
+                bool ok;
+                if (key == "rom")
+                {
+                    ok = read_string(result.rom);
+                }
+                else if (key == "engine")
+                {
+                    ok = read_string(result.engine);
+                }
+                else if (key == "quirks")
+                {
+                    ok = read_string(result.quirks);
+                }
+                else if (key == "tolerance")
+                {
+                    ok = read_number(result.tolerance);
+                }
+                else if (key == "samples")
+                {
+                    ok = expect('[');
+                    while (ok && !peek(']'))
+                    {
+                        double sample;
+                        ok = read_number(sample) && (peek(']') || expect(','));
+                        result.samples.push_back(sample);
+                    }
+                    ok = ok && expect(']');
+                }
+                else
+                {
+                    ok = skip_value();
+                }
+                if (!ok || (!peek('}') && !expect(',')))
+                {
+                    return false;
+                }
+            }
+            expect('}');
+            summarize(result);
+            results.push_back(result);
+            if (!peek(']') && !expect(','))
+            {
+                return false;
+            }
+        }
+        return expect(']');
+    }
+
+    void skip_space()
+    {
+        while (at < text.size() && isspace((unsigned char)text[at]))
+        {
+            at++;
+        }
+    }
+
+    bool peek(char c)
+    {
+        skip_space();
+        return at < text.size() && text[at] == c;
+    }
+
+    bool expect(char c)
+    {
+        if (!peek(c))
+        {
+            return false;
+        }
+        at++;
+        return true;
+    }
+
+    bool read_string(std::string &out)
+    {
+        if (!expect('"'))
+        {
+            return false;
+        }
+        out.clear();
+        while (at < text.size() && text[at] != '"')
+        {
+            if (text[at] == '\\' && at + 1 < text.size())
+            {
+                at++;
+            }
+            out += text[at++];
+        }
+        return expect('"');
+    }
+
+    bool read_number(double &out)
+    {
+        skip_space();
+        const char *start = text.c_str() + at;
+        char *end;
+        out = strtod(start, &end);
+        if (end == start)
+        {
+            return false;
+        }
+        at += end - start;
+        return true;
+    }
+
+    bool skip_value()
+    {
+        skip_space();
+        if (at >= text.size())
+        {
+            return false;
+        }
+        char c = text[at];
+        if (c == '"')
+        {
+            std::string ignored;
+            return read_string(ignored);
+        }
+        if (c == '{' || c == '[')
+        {
+            char close = c == '{' ? '}' : ']';
+            at++;
+            while (!peek(close))
+            {
+                if (c == '{')
+                {
+                    std::string key;
+                    if (!read_string(key) || !expect(':'))
+                    {
+                        return false;
+                    }
+                }
+                if (!skip_value() || (!peek(close) && !expect(',')))
+                {
+                    return false;
+                }
+            }
+            return expect(close);
+        }
+        if (isalpha((unsigned char)c))
+        {
+            while (at < text.size() && isalpha((unsigned char)text[at]))
+            {
+                at++;
+            }
+            return true;
+        }
+        double ignored;
+        return read_number(ignored);
+    }
+
+    const std::string &text;
+    size_t at;
+};
+
+bool read_bench_json(const char *filename, std::vector<bench_result> &results)
+{
+    FILE *file = fopen(filename, "r");
+    if (file == NULL)
+    {
+        return false;
+    }
+    std::string text;
+    char buffer[4096];
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    {
+        text.append(buffer, count);
+    }
+    fclose(file);
+    json_reader reader(text);
+    return reader.read_results(results);
+}
+
+// continued fraction for the regularized incomplete beta function (numerical recipes' betacf)
+static double beta_fraction(double a, double b, double x)
+{
+    const double tiny = 1e-300;
+    double c = 1.0;
+    double d = 1.0 - (a + b) * x / (a + 1.0);
+    d = 1.0 / (fabs(d) < tiny ? tiny : d);
+    double h = d;
+    for (int m = 1; m <= 200; m++)
+    {
+        double m2 = 2.0 * m;
+        double step = m * (b - m) * x / ((a + m2 - 1.0) * (a + m2));
+        d = 1.0 + step * d;
+        d = 1.0 / (fabs(d) < tiny ? tiny : d);
+        c = 1.0 + step / c;
+        c = fabs(c) < tiny ? tiny : c;
+        h *= d * c;
+        step = -(a + m) * (a + b + m) * x / ((a + m2) * (a + m2 + 1.0));
+        d = 1.0 + step * d;
+        d = 1.0 / (fabs(d) < tiny ? tiny : d);
+        c = 1.0 + step / c;
+        c = fabs(c) < tiny ? tiny : c;
+        double delta = d * c;
+        h *= delta;
+        if (fabs(delta - 1.0) < 1e-12)
+        {
+            break;
+        }
+    }
+    return h;
+}
+
+static double incomplete_beta(double a, double b, double x)
+{
+    if (x <= 0.0)
+    {
+        return 0.0;
+    }
+    if (x >= 1.0)
+    {
+        return 1.0;
+    }
+    double front = exp(lgamma(a + b) - lgamma(a) - lgamma(b) + a * log(x) + b * log(1.0 - x));
+    if (x < (a + 1.0) / (a + b + 2.0))
+    {
+        return front * beta_fraction(a, b, x) / a;
+    }
+    return 1.0 - front * beta_fraction(b, a, 1.0 - x) / b;
+}
+
+// one-sided p value that current is slower than baseline, welch's t-test with welch-satterthwaite degrees of freedom
+static double slower_p_value(const bench_result &baseline, const bench_result &current)
+{
+    double n1 = baseline.samples.size();
+    double n2 = current.samples.size();
+    if (n1 < 2 || n2 < 2)
+    {
+        return current.mean > baseline.mean ? 0.0 : 1.0;
+    }
+    double v1 = baseline.stddev * baseline.stddev / n1;
+    double v2 = current.stddev * current.stddev / n2;
+    if (v1 + v2 == 0.0)
+    {
+        // no noise at all, any difference is real
+        return current.mean > baseline.mean ? 0.0 : 1.0;
+    }
+    double t = (current.mean - baseline.mean) / sqrt(v1 + v2);
+    double df = (v1 + v2) * (v1 + v2) / (v1 * v1 / (n1 - 1) + v2 * v2 / (n2 - 1));
+    double two_sided = incomplete_beta(df / 2.0, 0.5, df / (df + t * t));
+    return t > 0 ? two_sided / 2.0 : 1.0 - two_sided / 2.0;
+}
+
+int compare_to_baseline(const std::vector<bench_result> &baseline, const std::vector<bench_result> &current,
+                        double default_tolerance, double significance, FILE *out)
+{
+    int regressions = 0;
+    fprintf(out, "\n%-16s %-10s %-8s %10s %10s %8s %8s  %s\n", "rom", "engine", "quirks", "baseline", "current", "change",
+            "p", "verdict");
+    for (size_t i = 0; i < current.size(); i++)
+    {
+        const bench_result &now = current[i];
+        const bench_result *before = NULL;
+        for (size_t j = 0; j < baseline.size() && before == NULL; j++)
+        {
+            if (baseline[j].rom == now.rom && baseline[j].engine == now.engine && baseline[j].quirks == now.quirks)
+            {
+                before = &baseline[j];
+            }
+        }
+        if (before == NULL || before->mean <= 0)
+        {
+            fprintf(out, "%-16s %-10s %-8s %10s %10.2f %8s %8s  new\n", now.rom.c_str(), now.engine.c_str(),
+                    now.quirks.c_str(), "-", now.mean, "-", "-");
+            continue;
+        }
+        double change = 100.0 * (now.mean - before->mean) / before->mean;
+        double tolerance = before->tolerance >= 0 ? before->tolerance : default_tolerance;
+        double p = slower_p_value(*before, now);
+        const char *verdict = "ok";
+        if (change > tolerance && p < significance)
+        {
+            verdict = "REGRESSION";
+            regressions++;
+        }
+        else if (change > tolerance)
+        {
+            verdict = "slower, within noise";
+        }
+        else if (change < -tolerance)
+        {
+            verdict = "faster";
+        }
+        fprintf(out, "%-16s %-10s %-8s %10.2f %10.2f %+7.1f%% %8.4f  %s\n", now.rom.c_str(), now.engine.c_str(),
+                now.quirks.c_str(), before->mean, now.mean, change, p, verdict);
+    }
+    fprintf(out, "\n%d regression%s\n", regressions, regressions == 1 ? "" : "s");
+    return regressions;
+}
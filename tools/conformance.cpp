@@ -0,0 +1,239 @@
+#include "../chip8.hpp"
+#include "../frame_timing.hpp"
+#include "../headless.hpp"
+#include "../mapped_file.hpp"
+#include "../recompiler.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/* golden frame conformance suite for the bundled test roms
+every rom in the golden file runs headless without input for its frame count under each quirk profile listed for it, on
+the table and predecode engines, and the final framebuffer hash has to match the golden value
+usage: conformance [--golden FILE] [--update] [--verbose] [--native]
+--native adds the native engine, left out by default since its first run compiles every rom and the suite is meant to
+stay fast enough to run after every change, ctest covers native separately through recompile --verify
+--update reruns the default rom list under every quirk profile and rewrites the golden file, after checking that all
+engines agree, so a deliberate behaviour change is one command plus a reviewable diff of the file
+run it from the repository root, rom paths in the golden file are relative */
+
+const char *default_roms[] = {"1-chip8-logo.ch8", "2-ibm-logo.ch8", "3-corax+.ch8", "4-flags.ch8", "c8_test.c8", NULL};
+// long enough for every default rom to reach its final screen
+const uint32_t default_frames = 200;
+
+struct golden_frame
+{
+    std::string rom;
+    std::string quirks;
+    uint32_t frames;
+    uint64_t screen_hash;
+};
+
+bool load_golden(const char *filename, std::vector<golden_frame> &golden)
+{
+    FILE *file = fopen(filename, "r");
+    if (file == NULL)
+    {
+        return false;
+    }
+    char line[4096];
+    while (fgets(line, sizeof(line), file))
+    {
+        if (line[0] == '#' || line[0] == '\n')
+        {
+            continue;
+        }
+        char rom[2048];
+        char quirks[64];
+        unsigned long frames;
+        unsigned long long hash;
+        if (sscanf(line, "%2047s %63s %lu %llx", rom, quirks, &frames, &hash) == 4)
+        {
+            golden_frame entry;
+            entry.rom = rom;
+            entry.quirks = quirks;
+            entry.frames = frames;
+            entry.screen_hash = hash;
+            golden.push_back(entry);
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+bool save_golden(const char *filename, const std::vector<golden_frame> &golden)
+{
+    FILE *file = fopen(filename, "w");
+    if (file == NULL)
+    {
+        return false;
+    }
+    fprintf(file, "# golden frames for tools/conformance: rom quirks frames screen_hash\n");
+    fprintf(file, "# regenerate with ./conformance --update after a deliberate behaviour change\n");
+    for (size_t i = 0; i < golden.size(); i++)
+    {
+        fprintf(file, "%s\t%s\t%u\t%016llx\n", golden[i].rom.c_str(), golden[i].quirks.c_str(), golden[i].frames,
+                (unsigned long long)golden[i].screen_hash);
+    }
+    return fclose(file) == 0;
+}
+
+void print_screen(const chip8 &cpu)
+{
+    for (int y = 0; y < cpu.screen_height(); y++)
+    {
+        for (int x = 0; x < cpu.screen_width(); x++)
+        {
+            fputc(cpu.pixel(x, y) ? '#' : '.', stderr);
+        }
+        fputc('\n', stderr);
+    }
+}
+
+// runs one rom under one profile on one engine, false if the rom could not be loaded
+bool run(const std::string &rom, const quirk_profile &quirks, int engine, uint32_t frames, chip8 &cpu)
+{
+    cpu.seed(1);
+    cpu.set_quirks(quirks);
+    if (!cpu.load_file(rom.c_str()))
+    {
+        return false;
+    }
+    cpu.set_engine((chip8::engine_type)engine);
+    // compiled on the first run, from the cache after that
+    if (engine == chip8::engine_native)
+    {
+        mapped_file file;
+        if (!file.open(rom.c_str()))
+        {
+            return false;
+        }
+        cpu.set_native(load_native(file.data(), file.size(), cpu.platform(), default_native_cache().c_str()));
+    }
+    headless_options options;
+    options.frames = frames;
+    run_headless(cpu, options);
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *golden_file = "golden_frames.txt";
+    bool update = false;
+    bool verbose = false;
+    int engines = chip8::engine_native;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--golden") == 0 && i + 1 < argc)
+        {
+            golden_file = argv[++i];
+        }
+        else if (strcmp(argv[i], "--update") == 0)
+        {
+            update = true;
+        }
+        else if (strcmp(argv[i], "--verbose") == 0)
+        {
+            verbose = true;
+        }
+        else if (strcmp(argv[i], "--native") == 0)
+        {
+            engines = chip8::engine_count;
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--golden FILE] [--update] [--verbose] [--native]\n", argv[0]);
+            exit(1);
+        }
+    }
+
+    std::vector<golden_frame> golden;
+    if (update)
+    {
+        for (int r = 0; default_roms[r] != NULL; r++)
+        {
+            for (const quirk_profile *profile = chip8::quirk_profiles(); profile->name != NULL; profile++)
+            {
+                golden_frame entry;
+                entry.rom = default_roms[r];
+                entry.quirks = profile->name;
+                entry.frames = default_frames;
+                entry.screen_hash = 0;
+                golden.push_back(entry);
+            }
+        }
+    }
+    else if (!load_golden(golden_file, golden))
+    {
+        fprintf(stderr, "could not read %s\n", golden_file);
+        exit(1);
+    }
+
+    uint64_t start = now_ns();
+    int failures = 0;
+    int runs = 0;
+    for (size_t i = 0; i < golden.size(); i++)
+    {
+        golden_frame &entry = golden[i];
+        const quirk_profile *quirks = chip8::find_quirks(entry.quirks.c_str());
+        if (quirks == NULL)
+        {
+            fprintf(stderr, "%s: unknown quirk profile %s\n", entry.rom.c_str(), entry.quirks.c_str());
+            failures++;
+            continue;
+        }
+        // the reference engine's hash is what gets written on --update, every other engine has to agree with it
+        uint64_t reference = 0;
+        for (int engine = 0; engine < engines; engine++)
+        {
+            chip8 cpu;
+            if (!run(entry.rom, *quirks, engine, entry.frames, cpu))
+            {
+                fprintf(stderr, "%s: could not load\n", entry.rom.c_str());
+                failures++;
+                break;
+            }
+            runs++;
+            uint64_t hash = cpu.screen_hash();
+            if (engine == chip8::engine_table)
+            {
+                reference = hash;
+            }
+            uint64_t expected = update ? reference : entry.screen_hash;
+            bool ok = hash == expected;
+            if (!ok || verbose)
+            {
+                printf("%-18s %-8s %-10s %016llx %s\n", entry.rom.c_str(), entry.quirks.c_str(), chip8::engine_name(engine),
+                       (unsigned long long)hash, ok ? "ok" : "FAIL");
+            }
+            if (!ok)
+            {
+                fprintf(stderr, "expected %016llx after %u frames, got:\n", (unsigned long long)expected, entry.frames);
+                print_screen(cpu);
+                failures++;
+            }
+        }
+        entry.screen_hash = reference;
+    }
+    double ms = (now_ns() - start) / 1e6;
+
+    if (update)
+    {
+        if (failures > 0)
+        {
+            fprintf(stderr, "engines disagree, %s left alone\n", golden_file);
+            return 1;
+        }
+        if (!save_golden(golden_file, golden))
+        {
+            fprintf(stderr, "could not write %s\n", golden_file);
+            return 1;
+        }
+        printf("wrote %zu golden frames to %s\n", golden.size(), golden_file);
+        return 0;
+    }
+    printf("%d runs, %d failures, %.1f ms\n", runs, failures, ms);
+    return failures ? 1 : 0;
+}
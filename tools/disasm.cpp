@@ -0,0 +1,158 @@
+#include "../chip8.hpp"
+#include "../control_flow.hpp"
+#include "../disassembler.hpp"
+#include "../frame_timing.hpp"
+#include "../mapped_file.hpp"
+#include "../rom_library.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// static disassembler, recovers the rom's control flow graph (see control_flow.hpp) and prints a listing of it
+// usage: disasm ROM [--platform chip8|xochip] [--blocks] [--dot] [--bench N]
+// the platform defaults to whatever the rom's opcodes point to, --blocks prints the basic blocks and their successors
+// instead of the listing, --dot the graph in graphviz format, --bench times N analyses of the rom
+
+void usage(const char *program)
+{
+    fprintf(stderr, "usage: %s ROM [--platform chip8|xochip] [--blocks] [--dot] [--bench N]\n", program);
+    exit(1);
+}
+
+const char *exit_name(block_exit exit)
+{
+    static const char *names[] = {"fallthrough", "jump", "skip", "call", "return", "indirect", "halt"};
+    return names[exit];
+}
+
+void print_blocks(const control_flow_graph &graph)
+{
+    for (size_t i = 0; i < graph.blocks.size(); i++)
+    {
+        const cfg_block &block = graph.blocks[i];
+        printf("%03X-%03X  %-11s", block.begin, block.end - 1, exit_name(block.exit));
+        int targets = block.exit == exit_skip || block.exit == exit_call ? 2 : block.exit <= exit_jump ? 1 : 0;
+        for (int t = 0; t < targets; t++)
+        {
+            // a target no block starts at is outside the rom, or the middle of an instruction
+            printf(" %03X%s", block.targets[t], graph.find_block(block.targets[t]) < 0 ? "?" : "");
+        }
+        printf("\n");
+    }
+}
+
+void print_dot(const control_flow_graph &graph)
+{
+    printf("digraph rom {\n    node [shape=box fontname=monospace];\n");
+    for (size_t i = 0; i < graph.blocks.size(); i++)
+    {
+        const cfg_block &block = graph.blocks[i];
+        printf("    b%03X [label=\"%03X-%03X\"];\n", block.begin, block.begin, block.end - 1);
+        switch (block.exit)
+        {
+        case exit_fallthrough:
+        case exit_jump:
+            printf("    b%03X -> b%03X;\n", block.begin, block.targets[0]);
+            break;
+        case exit_skip:
+            printf("    b%03X -> b%03X;\n    b%03X -> b%03X [style=dashed];\n", block.begin, block.targets[0], block.begin,
+                   block.targets[1]);
+            break;
+        case exit_call:
+            printf("    b%03X -> b%03X [color=blue];\n    b%03X -> b%03X;\n", block.begin, block.targets[0], block.begin,
+                   block.targets[1]);
+            break;
+        default:
+            break;
+        }
+    }
+    printf("}\n");
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2 || argv[1][0] == '-')
+    {
+        usage(argv[0]);
+    }
+    const char *platform_choice = NULL;
+    bool blocks = false;
+    bool dot = false;
+    int bench = 0;
+    for (int i = 2; i < argc; i++)
+    {
+        bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--platform") == 0 && has_value)
+        {
+            platform_choice = argv[++i];
+        }
+        else if (strcmp(argv[i], "--blocks") == 0)
+        {
+            blocks = true;
+        }
+        else if (strcmp(argv[i], "--dot") == 0)
+        {
+            dot = true;
+        }
+        else if (strcmp(argv[i], "--bench") == 0 && has_value)
+        {
+            bench = atoi(argv[++i]);
+        }
+        else
+        {
+            usage(argv[0]);
+        }
+    }
+
+    mapped_file rom;
+    if (!rom.open(argv[1]))
+    {
+        fprintf(stderr, "could not read %s\n", argv[1]);
+        exit(1);
+    }
+    // super-chip is always on, only xo-chip changes how the rom decodes
+    chip8::platform_type platform = chip8::platform_chip8;
+    if (platform_choice != NULL)
+    {
+        platform = chip8::find_platform(platform_choice);
+        if (platform == chip8::platform_count)
+        {
+            fprintf(stderr, "unknown platform %s\n", platform_choice);
+            exit(1);
+        }
+    }
+    else if (strcmp(detect_platform(rom.data(), rom.size()), "xochip") == 0)
+    {
+        platform = chip8::platform_xochip;
+    }
+
+    control_flow_graph graph;
+    if (bench > 0)
+    {
+        uint64_t start = now_ns();
+        for (int i = 0; i < bench; i++)
+        {
+            analyze_control_flow(rom.data(), rom.size(), platform, graph);
+        }
+        uint64_t elapsed = now_ns() - start;
+        printf("%zu bytes, %zu blocks, %zu subroutines, %.2f us per analysis\n", rom.size(), graph.blocks.size(),
+               graph.subroutines.size(), elapsed / 1e3 / bench);
+        return 0;
+    }
+    analyze_control_flow(rom.data(), rom.size(), platform, graph);
+    if (blocks)
+    {
+        print_blocks(graph);
+    }
+    else if (dot)
+    {
+        print_dot(graph);
+    }
+    else
+    {
+        printf("; %s, %zu bytes, %s, %zu blocks, %zu subroutines\n", argv[1], rom.size(), chip8::platform_name(platform),
+               graph.blocks.size(), graph.subroutines.size());
+        write_listing(stdout, rom.data(), rom.size(), platform, graph);
+    }
+    return 0;
+}
@@ -0,0 +1,205 @@
+#include "../chip8.hpp"
+#include "../rom_cache.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+// breadth-first explorer of the states a rom can reach
+// every time the program is about to read the keypad (Ex9E, ExA1, Fx0A) the search branches on "no key" plus each of the
+// 16 keys, runs each branch to the next poll, and keeps only states whose hash has not been seen before
+// usage: explorer ROM [--depth N] [--threads N] [--max-frontier N] [--max-cycles N]
+
+const int cycles_per_frame = 10;
+
+struct node
+{
+    chip8 cpu;
+    // cycles executed in the current frame, timers tick when this wraps
+    int phase;
+};
+
+// the visited set is split into shards so threads only contend when they hash into the same one
+class visited_set
+{
+public:
+    static const int shard_count = 64;
+
+    // returns true if the hash was not present before
+    bool insert(uint64_t hash)
+    {
+        shard &s = shards[hash % shard_count];
+        std::lock_guard<std::mutex> lock(s.mutex);
+        return s.hashes.insert(hash).second;
+    }
+
+    size_t size()
+    {
+        size_t total = 0;
+        for (int i = 0; i < shard_count; i++)
+        {
+            std::lock_guard<std::mutex> lock(shards[i].mutex);
+            total += shards[i].hashes.size();
+        }
+        return total;
+    }
+
+private:
+    struct shard
+    {
+        std::mutex mutex;
+        std::unordered_set<uint64_t> hashes;
+    };
+    shard shards[shard_count];
+};
+
+uint64_t node_hash(const node &n)
+{
+    // the frame phase decides when the timers tick next, so it is part of what makes two states equal
+    return n.cpu.state_hash() ^ chip8::hash_key(0x30000, n.phase);
+}
+
+// runs one cycle at a time until the next input poll or until the budget runs out
+// returns false when the budget ran out, the branch is then dropped as non interactive
+bool run_to_poll(node &n, int max_cycles)
+{
+    for (int i = 0; i < max_cycles; i++)
+    {
+        n.cpu.emulate_cycle();
+        if (++n.phase == cycles_per_frame)
+        {
+            n.phase = 0;
+            n.cpu.decrement_timers();
+        }
+        if (n.cpu.at_input_poll())
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void usage(const char *program)
+{
+    fprintf(stderr, "usage: %s ROM [--depth N] [--threads N] [--max-frontier N] [--max-cycles N]\n", program);
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2 || argv[1][0] == '-')
+    {
+        usage(argv[0]);
+    }
+
+    int max_depth = 8;
+    int thread_count = std::thread::hardware_concurrency();
+    size_t max_frontier = 20000;
+    int max_cycles = 100000;
+    for (int i = 2; i < argc; i++)
+    {
+        bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--depth") == 0 && has_value)
+        {
+            max_depth = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && has_value)
+        {
+            thread_count = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--max-frontier") == 0 && has_value)
+        {
+            max_frontier = strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--max-cycles") == 0 && has_value)
+        {
+            max_cycles = atoi(argv[++i]);
+        }
+        else
+        {
+            usage(argv[0]);
+        }
+    }
+    if (thread_count < 1)
+    {
+        thread_count = 1;
+    }
+
+    std::vector<node> frontier(1);
+    frontier[0].cpu.seed(1);
+    frontier[0].phase = 0;
+    // every node descends from the root by copying, so the whole search shares the cached image's pages
+    if (!load_shared(frontier[0].cpu, argv[1]))
+    {
+        fprintf(stderr, "could not load %s\n", argv[1]);
+        exit(1);
+    }
+    if (!frontier[0].cpu.at_input_poll() && !run_to_poll(frontier[0], max_cycles))
+    {
+        fprintf(stderr, "rom never polls the keypad within %d cycles\n", max_cycles);
+        exit(1);
+    }
+
+    visited_set visited;
+    visited.insert(node_hash(frontier[0]));
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    unsigned long long total_expanded = 0;
+
+    for (int depth = 1; depth <= max_depth && !frontier.empty(); depth++)
+    {
+        std::atomic<size_t> next_index(0);
+        std::vector<std::vector<node> > produced(thread_count);
+        std::vector<std::thread> workers;
+
+        // each worker claims the next unexpanded frontier node, tries all 17 inputs on a copy of it, and keeps the new states
+        for (int t = 0; t < thread_count; t++)
+        {
+            workers.push_back(std::thread([&, t]() {
+                std::vector<node> &out = produced[t];
+                for (size_t index = next_index++; index < frontier.size(); index = next_index++)
+                {
+                    for (int key = -1; key < 16; key++)
+                    {
+                        node child = frontier[index];
+                        std::fill(std::begin(child.cpu.keypad), std::end(child.cpu.keypad), 0);
+                        if (key >= 0)
+                        {
+                            child.cpu.keypad[key] = 1;
+                        }
+                        if (run_to_poll(child, max_cycles) && visited.insert(node_hash(child)))
+                        {
+                            out.push_back(child);
+                        }
+                    }
+                }
+            }));
+        }
+        for (size_t t = 0; t < workers.size(); t++)
+        {
+            workers[t].join();
+        }
+
+        total_expanded += frontier.size();
+        std::vector<node> next;
+        for (int t = 0; t < thread_count; t++)
+        {
+            for (size_t i = 0; i < produced[t].size() && next.size() < max_frontier; i++)
+            {
+                next.push_back(produced[t][i]);
+            }
+        }
+        frontier.swap(next);
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        printf("depth %d: frontier %zu, visited %zu, %.0f expansions/s\n", depth, frontier.size(), visited.size(),
+               seconds > 0 ? total_expanded * 17 / seconds : 0.0);
+    }
+
+    return 0;
+}
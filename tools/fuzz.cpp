@@ -0,0 +1,352 @@
+#include "../chip8.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/* differential fuzzer, every interpreting engine has to match the table engine (the reference op_* semantics) exactly
+an input is a small header that sets up the machine followed by rom bytes, the reference and each other engine run it
+side by side for a bounded number of cycles and their state hashes and faults are compared after every cycle
+header layout (missing bytes read as zero):
+  0        quirk profile index in bits 0-6, bit 7 selects xo-chip
+  1..2     keypad bitmask, key 0 in the low bit
+  3..6     op_Cxkk seed
+  7..22    V0-VF
+  23..24   I
+  25       sp
+  26..57   stack, 16 big endian words
+  58       delay timer
+  59       sound timer
+  60..     rom, loaded at 0x200 where pc starts
+built with -DCHIP8_LIBFUZZER (and -fsanitize=fuzzer) this is a libFuzzer target that aborts on the first mismatch,
+otherwise it generates its own random inputs
+usage: fuzz [--runs N] [--seed N] [--cycles N] [--max-size BYTES] [--out DIR] [INPUT...]
+with INPUT files it replays them instead, e.g. a mismatch written by an earlier run */
+
+const size_t header_size = 60;
+const int cycles_per_frame = 10;
+
+struct fuzz_input
+{
+    const uint8_t *data;
+    size_t size;
+
+    uint8_t byte(size_t at) const { return at < size ? data[at] : 0; }
+    uint16_t word(size_t at) const { return byte(at) << 8 | byte(at + 1); }
+};
+
+void setup(chip8 &cpu, const fuzz_input &input, int engine)
+{
+    const quirk_profile *profiles = chip8::quirk_profiles();
+    int profile_count = 0;
+    while (profiles[profile_count].name != NULL)
+    {
+        profile_count++;
+    }
+    cpu.set_platform(input.byte(0) & 0x80 ? chip8::platform_xochip : chip8::platform_chip8);
+    cpu.set_quirks(profiles[(input.byte(0) & 0x7F) % profile_count]);
+
+    uint16_t keys = input.word(1);
+    for (int i = 0; i < 16; i++)
+    {
+        cpu.keypad[i] = (keys >> i) & 1;
+    }
+    cpu.seed((uint32_t)input.word(3) << 16 | input.word(5));
+
+    chip8_registers registers;
+    for (int i = 0; i < 16; i++)
+    {
+        registers.V[i] = input.byte(7 + i);
+        registers.stack[i] = input.word(26 + i * 2);
+    }
+    registers.I = input.word(23);
+    registers.pc = 0x200;
+    registers.sp = input.byte(25);
+    registers.delay_timer = input.byte(58);
+    registers.sound_timer = input.byte(59);
+    cpu.set_registers(registers);
+
+    if (input.size > header_size)
+    {
+        // anything past the end of memory is cut off rather than rejected, the fuzzer does not know the limit
+        size_t memory_size = cpu.platform() == chip8::platform_xochip ? 0x10000 : 0x1000;
+        size_t rom_size = std::min<size_t>(input.size - header_size, memory_size - 0x200);
+        cpu.load_bytes(input.data + header_size, rom_size);
+    }
+    cpu.set_engine((chip8::engine_type)engine);
+}
+
+void print_registers(const char *label, const chip8 &cpu)
+{
+    chip8_registers r = cpu.get_registers();
+    fprintf(stderr, "%-10s pc %03X I %04X sp %X dt %02X st %02X V", label, r.pc, r.I, r.sp, r.delay_timer, r.sound_timer);
+    for (int i = 0; i < 16; i++)
+    {
+        fprintf(stderr, " %02X", r.V[i]);
+    }
+    fprintf(stderr, "\n%-10s screen %016llx state %016llx fault %s at %03X\n", "", (unsigned long long)cpu.screen_hash(),
+            (unsigned long long)cpu.state_hash(), chip8::fault_name(cpu.fault), cpu.fault_pc);
+}
+
+// runs one input on the reference and every other engine, returns false and reports on the first divergence
+bool check(const fuzz_input &input, int cycles)
+{
+    // native code needs a compiler run per rom, recompile --verify is its differential test
+    for (int engine = chip8::engine_table + 1; engine < chip8::engine_native; engine++)
+    {
+        chip8 reference;
+        chip8 candidate;
+        setup(reference, input, chip8::engine_table);
+        setup(candidate, input, engine);
+        for (int cycle = 0; cycle < cycles; cycle++)
+        {
+            chip8_registers before = reference.get_registers();
+            reference.emulate_cycle();
+            candidate.emulate_cycle();
+            if ((cycle + 1) % cycles_per_frame == 0)
+            {
+                reference.decrement_timers();
+                candidate.decrement_timers();
+            }
+            // faults are not part of the state, but every engine has to raise the same ones at the same place
+            if (reference.state_hash() != candidate.state_hash() || reference.fault != candidate.fault ||
+                reference.fault_pc != candidate.fault_pc)
+            {
+                fprintf(stderr, "%s diverges from %s at cycle %d, pc was %03X\n", chip8::engine_name(engine),
+                        chip8::engine_name(chip8::engine_table), cycle, before.pc);
+                print_registers(chip8::engine_name(chip8::engine_table), reference);
+                print_registers(chip8::engine_name(engine), candidate);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+#ifdef CHIP8_LIBFUZZER
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    fuzz_input input = {data, size};
+    if (!check(input, 2000))
+    {
+        abort();
+    }
+    return 0;
+}
+
+#else
+
+uint32_t rng_state = 1;
+
+uint32_t next_random()
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+/* plain random bytes almost never get past the first few instructions before hitting a 0nnn or jumping into the void,
+so most generated roms are biased: opcodes are built from a random leading nibble with a valid low byte for the
+families that have sub tables, jumps and calls stay inside the rom, and I mostly points into the rom or the font
+half the roms are xo-chip ones and also get its opcodes */
+void generate(std::vector<uint8_t> &bytes, size_t max_size)
+{
+    size_t rom_size = 2 + next_random() % (max_size / 2) * 2;
+    bytes.resize(header_size + rom_size);
+    for (size_t i = 0; i < bytes.size(); i++)
+    {
+        bytes[i] = next_random() >> 24;
+    }
+    if (next_random() % 8 == 0)
+    {
+        // keep some inputs completely raw
+        return;
+    }
+    bool xo = bytes[0] & 0x80;
+    static const uint8_t zero_ops[] = {0xE0, 0xEE, 0xC0, 0xFB, 0xFC, 0xFD, 0xFE, 0xFF, 0xD0};
+    static const uint8_t f_ops[] = {0x07, 0x0A, 0x15, 0x18, 0x1E, 0x29, 0x30, 0x33, 0x55, 0x65, 0x75, 0x85, 0x00, 0x01, 0x02, 0x3A};
+    int zero_count = xo ? 9 : 8;
+    int f_count = xo ? 16 : 12;
+    static const uint8_t eight_ops[] = {0x0, 0x1, 0x2, 0x3, 0x4, 0x5, 0x6, 0x7, 0xE};
+    for (size_t at = header_size; at + 1 < bytes.size(); at += 2)
+    {
+        uint16_t op = next_random() & 0xFFFF;
+        uint16_t target = 0x200 + next_random() % rom_size;
+        switch (op >> 12)
+        {
+        case 0x0:
+            op = zero_ops[next_random() % zero_count];
+            if (op == 0xC0 || op == 0xD0)
+            {
+                op |= next_random() % 16;
+            }
+            break;
+        case 0x1:
+        case 0x2:
+        case 0xB:
+            op = (op & 0xF000) | target;
+            break;
+        case 0x5:
+            op = (op & 0xFFF0) | (xo ? next_random() % 4 : 0);
+            break;
+        case 0x8:
+            op = (op & 0xFFF0) | eight_ops[next_random() % 9];
+            break;
+        case 0xA:
+            op = 0xA000 | (next_random() % 4 == 0 ? next_random() % 0x50 : target);
+            break;
+        case 0xE:
+            op = (op & 0xFF00) | (next_random() % 2 ? 0x9E : 0xA1);
+            break;
+        case 0xF:
+            op = (op & 0xFF00) | f_ops[next_random() % f_count];
+            break;
+        }
+        bytes[at] = op >> 8;
+        bytes[at + 1] = op & 0xFF;
+    }
+}
+
+/* inputs that once broke an engine, they run ahead of the random ones
+an xo-chip rom filling memory up to 0xFFFF that stores to 0xFFFF, patching the predecoded instruction around the last
+byte used to wrap its address and never stop */
+void regressions(std::vector<std::vector<uint8_t> > &inputs)
+{
+    static const uint8_t write_last_byte[] = {0xF0, 0x00, 0xFF, 0xFF, 0x60, 0x12, 0xF0, 0x55};
+    std::vector<uint8_t> bytes(header_size + 0x10000 - 0x200);
+    bytes[0] = 0x80;
+    std::copy(write_last_byte, write_last_byte + sizeof(write_last_byte), bytes.begin() + header_size);
+    inputs.push_back(bytes);
+}
+
+bool write_file(const std::string &path, const std::vector<uint8_t> &bytes)
+{
+    FILE *file = fopen(path.c_str(), "wb");
+    if (file == NULL)
+    {
+        return false;
+    }
+    fwrite(bytes.data(), 1, bytes.size(), file);
+    fclose(file);
+    return true;
+}
+
+bool read_file(const char *path, std::vector<uint8_t> &bytes)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        return false;
+    }
+    uint8_t buffer[4096];
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    {
+        bytes.insert(bytes.end(), buffer, buffer + count);
+    }
+    fclose(file);
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned long runs = 10000;
+    int cycles = 2000;
+    size_t max_size = 512;
+    std::string out_dir = ".";
+    std::vector<const char *> inputs;
+    for (int i = 1; i < argc; i++)
+    {
+        bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--runs") == 0 && has_value)
+        {
+            runs = strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--seed") == 0 && has_value)
+        {
+            rng_state = strtoul(argv[++i], NULL, 10) | 1;
+        }
+        else if (strcmp(argv[i], "--cycles") == 0 && has_value)
+        {
+            cycles = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--max-size") == 0 && has_value)
+        {
+            max_size = strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--out") == 0 && has_value)
+        {
+            out_dir = argv[++i];
+        }
+        else if (argv[i][0] == '-')
+        {
+            fprintf(stderr, "usage: %s [--runs N] [--seed N] [--cycles N] [--max-size BYTES] [--out DIR] [INPUT...]\n",
+                    argv[0]);
+            exit(1);
+        }
+        else
+        {
+            inputs.push_back(argv[i]);
+        }
+    }
+    if (max_size < 2 || max_size > 0x1000 - 0x200)
+    {
+        fprintf(stderr, "max size must be between 2 and %d bytes\n", 0x1000 - 0x200);
+        exit(1);
+    }
+
+    if (!inputs.empty())
+    {
+        int failures = 0;
+        for (size_t i = 0; i < inputs.size(); i++)
+        {
+            std::vector<uint8_t> bytes;
+            if (!read_file(inputs[i], bytes))
+            {
+                fprintf(stderr, "could not read %s\n", inputs[i]);
+                exit(1);
+            }
+            fuzz_input input = {bytes.data(), bytes.size()};
+            bool ok = check(input, cycles);
+            printf("%s: %s\n", inputs[i], ok ? "ok" : "MISMATCH");
+            failures += !ok;
+        }
+        return failures ? 1 : 0;
+    }
+
+    std::vector<std::vector<uint8_t> > fixed;
+    regressions(fixed);
+    for (size_t i = 0; i < fixed.size(); i++)
+    {
+        fuzz_input input = {fixed[i].data(), fixed[i].size()};
+        if (!check(input, cycles))
+        {
+            fprintf(stderr, "regression input %zu\n", i);
+            return 1;
+        }
+    }
+
+    for (unsigned long run = 0; run < runs; run++)
+    {
+        std::vector<uint8_t> bytes;
+        generate(bytes, max_size);
+        fuzz_input input = {bytes.data(), bytes.size()};
+        if (!check(input, cycles))
+        {
+            std::string path = out_dir + "/fuzz-mismatch-" + std::to_string(run) + ".bin";
+            if (write_file(path, bytes))
+            {
+                fprintf(stderr, "input written to %s\n", path.c_str());
+            }
+            return 1;
+        }
+    }
+    printf("%lu runs of %d cycles, no mismatches\n", runs, cycles);
+    return 0;
+}
+
+#endif
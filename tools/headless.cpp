@@ -0,0 +1,219 @@
+#include "../chip8.hpp"
+#include "../frame_timing.hpp"
+#include "../headless.hpp"
+#include "../mapped_file.hpp"
+#include "../perf_counters.hpp"
+#include "../recompiler.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// runs a rom without a window and prints the final state hashes
+// usage: headless ROM [--frames N] [--ipf N] [--engine table|predecode|native] [--quirks NAME] [--platform chip8|xochip] [--seed N]
+//                     [--input SCRIPT] [--screen] [--perf] [--wav FILE]
+// --perf reads the cpu's hardware counters around the run and reports them per emulated chip8 instruction, which is the
+// number to compare engines by
+// --wav renders the sound in emulated time, sample accurate whatever speed the run actually went at, and writes it out
+
+void usage(const char *program)
+{
+    fprintf(stderr, "usage: %s ROM [--frames N] [--ipf N] [--engine table|predecode|native] [--quirks NAME] [--platform chip8|xochip] "
+                    "[--seed N] [--input SCRIPT] [--screen] [--perf] [--wav FILE]\n",
+            program);
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc <= 1)
+    {
+        usage(argv[0]);
+    }
+
+    headless_options options;
+    // read signed so a negative count is caught below instead of wrapping to billions of frames
+    long frames = options.frames;
+    int engine = chip8::engine_table;
+    const quirk_profile *quirks = chip8::find_quirks("default");
+    chip8::platform_type platform = chip8::platform_chip8;
+    uint32_t seed = 1;
+    bool show_screen = false;
+    bool use_perf = false;
+    const char *wav_file = NULL;
+    for (int i = 2; i < argc; i++)
+    {
+        bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--frames") == 0 && has_value)
+        {
+            frames = strtol(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--ipf") == 0 && has_value)
+        {
+            options.ipf = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--engine") == 0 && has_value)
+        {
+            const char *name = argv[++i];
+            for (engine = 0; engine < chip8::engine_count && strcmp(chip8::engine_name(engine), name) != 0; engine++)
+            {
+            }
+            if (engine == chip8::engine_count)
+            {
+                fprintf(stderr, "unknown engine %s\n", name);
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--quirks") == 0 && has_value)
+        {
+            quirks = chip8::find_quirks(argv[++i]);
+            if (quirks == NULL)
+            {
+                fprintf(stderr, "unknown quirk profile %s\n", argv[i]);
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--platform") == 0 && has_value)
+        {
+            platform = chip8::find_platform(argv[++i]);
+            if (platform == chip8::platform_count)
+            {
+                fprintf(stderr, "unknown platform %s\n", argv[i]);
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--seed") == 0 && has_value)
+        {
+            seed = strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--input") == 0 && has_value)
+        {
+            if (!parse_input_script(argv[++i], options.input))
+            {
+                fprintf(stderr, "bad input script\n");
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--screen") == 0)
+        {
+            show_screen = true;
+        }
+        else if (strcmp(argv[i], "--perf") == 0)
+        {
+            use_perf = true;
+        }
+        else if (strcmp(argv[i], "--wav") == 0 && has_value)
+        {
+            wav_file = argv[++i];
+        }
+        else
+        {
+            usage(argv[0]);
+        }
+    }
+    // the rates reported below divide by both
+    if (frames < 1 || options.ipf < 1)
+    {
+        usage(argv[0]);
+    }
+    options.frames = frames;
+
+    chip8 cpu;
+    cpu.seed(seed);
+    cpu.set_platform(platform);
+    if (!cpu.load_file(argv[1]))
+    {
+        fprintf(stderr, "could not load %s\n", argv[1]);
+        exit(1);
+    }
+    cpu.set_engine((chip8::engine_type)engine);
+    cpu.set_quirks(*quirks);
+    if (engine == chip8::engine_native)
+    {
+        mapped_file rom;
+        if (!rom.open(argv[1]))
+        {
+            fprintf(stderr, "could not load %s\n", argv[1]);
+            exit(1);
+        }
+        cpu.set_native(load_native(rom.data(), rom.size(), platform, default_native_cache().c_str()));
+    }
+
+    perf_counters counters;
+    if (use_perf && !counters.open())
+    {
+        // keep going, the wall clock numbers are still worth having
+        fprintf(stderr, "hardware counters unavailable (check /proc/sys/kernel/perf_event_paranoid), timing only\n");
+    }
+
+    audio_renderer sound(48000, options.ipf * 60);
+    if (wav_file != NULL)
+    {
+        options.audio = &sound;
+    }
+
+    uint64_t start = now_ns();
+    counters.start();
+    headless_result result = run_headless(cpu, options);
+    counters.stop();
+    uint64_t elapsed = now_ns() - start;
+
+    printf("engine       %s\n", chip8::engine_name(cpu.engine()));
+    printf("quirks       %s\n", quirks->name);
+    printf("platform     %s\n", chip8::platform_name(cpu.platform()));
+    printf("frames       %u\n", result.frames);
+    printf("instructions %llu\n", (unsigned long long)result.instructions);
+    printf("state hash   %016llx\n", (unsigned long long)result.state_hash);
+    printf("screen hash  %016llx\n", (unsigned long long)result.screen_hash);
+    printf("time         %.3f ms, %.1f ns/instruction, %.2f MIPS\n", elapsed / 1e6,
+           (double)elapsed / result.instructions, result.instructions * 1e3 / elapsed);
+
+    if (use_perf)
+    {
+        for (int i = 0; i < perf_counters::counter_count; i++)
+        {
+            perf_counters::counter which = (perf_counters::counter)i;
+            if (counters.available(which))
+            {
+                uint64_t value = counters.value(which);
+                printf("%-14s %14llu, %.2f per chip8 instruction\n", perf_counters::name(i), (unsigned long long)value,
+                       (double)value / result.instructions);
+            }
+            else
+            {
+                printf("%-14s unavailable\n", perf_counters::name(i));
+            }
+        }
+    }
+
+    if (wav_file != NULL)
+    {
+        size_t audible = 0;
+        for (size_t i = 0; i < sound.samples.size(); i++)
+        {
+            audible += sound.samples[i] != 0;
+        }
+        if (!write_wav(wav_file, sound.samples, sound.sample_rate()))
+        {
+            fprintf(stderr, "could not write %s\n", wav_file);
+            exit(1);
+        }
+        printf("sound        %.3f s of %.3f s audible, written to %s\n", (double)audible / sound.sample_rate(),
+               (double)sound.samples.size() / sound.sample_rate(), wav_file);
+    }
+
+    if (show_screen)
+    {
+        for (int y = 0; y < cpu.screen_height(); y++)
+        {
+            for (int x = 0; x < cpu.screen_width(); x++)
+            {
+                // plane 0 alone is '#', xo-chip colors mixing other planes print as their palette index
+                int color = cpu.color(x, y);
+                putchar(color == 0 ? '.' : color == 1 ? '#' : "0123456789ABCDEF"[color]);
+            }
+            putchar('\n');
+        }
+    }
+
+    return 0;
+}
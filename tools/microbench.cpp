@@ -0,0 +1,235 @@
+#include "../chip8.hpp"
+#include "../frame_timing.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// per handler microbenchmarks, each case is a rom made of one opcode repeated over and over with a jump back at the end,
+// so nearly every cycle lands in the handler under test
+// the first case is 0001, which lands in op_NULL and does nothing, its time is the dispatch cost and is subtracted to get the handler's own cost
+// usage: microbench [--instructions N] [--repetitions N] [--engine NAME|all] [--filter TEXT]
+
+// placeholder in a body for "call the ret stub", 2NNN needs somewhere to return from
+const uint16_t call_stub = 0x2FFF;
+
+struct micro_case
+{
+    const char *name;
+    const char *quirks;
+    // runs once before the loop, sets up registers and I
+    std::vector<uint16_t> prelude;
+    // repeated to fill the loop
+    std::vector<uint16_t> body;
+};
+
+std::vector<uint16_t> ops(uint16_t a, int b = -1, int c = -1, int d = -1)
+{
+    std::vector<uint16_t> list(1, a);
+    if (b >= 0)
+    {
+        list.push_back(b);
+    }
+    if (c >= 0)
+    {
+        list.push_back(c);
+    }
+    if (d >= 0)
+    {
+        list.push_back(d);
+    }
+    return list;
+}
+
+std::vector<micro_case> build_cases()
+{
+    // common setup: v0 = 3, v1 = 7, v2 = 200, I = 0xF00 (outside the rom, so stores never touch code)
+    std::vector<uint16_t> setup = ops(0x6003, 0x6107, 0x62C8, 0xAF00);
+    std::vector<micro_case> cases;
+    micro_case c;
+    c.quirks = "default";
+    c.prelude = setup;
+
+#define MICRO(label, profile, ...)  \
+    c.name = label;                 \
+    c.quirks = profile;             \
+    c.body = ops(__VA_ARGS__);      \
+    cases.push_back(c);
+
+    MICRO("0001 dispatch", "default", 0x0001)
+    MICRO("00E0 cls", "default", 0x00E0)
+    MICRO("2NNN/00EE", "default", call_stub)
+    MICRO("3xkk taken", "default", 0x3003)
+    MICRO("3xkk not taken", "default", 0x3004)
+    MICRO("4xkk", "default", 0x4004)
+    MICRO("5xy0", "default", 0x5010)
+    MICRO("6xkk", "default", 0x6355)
+    MICRO("7xkk", "default", 0x7301)
+    MICRO("8xy0", "default", 0x8310)
+    MICRO("8xy1", "default", 0x8311)
+    MICRO("8xy1 vf reset", "chip8", 0x8311)
+    MICRO("8xy2", "default", 0x8312)
+    MICRO("8xy3", "default", 0x8313)
+    MICRO("8xy4", "default", 0x8324)
+    MICRO("8xy5", "default", 0x8325)
+    MICRO("8xy6", "default", 0x8316)
+    MICRO("8xy6 shift vy", "chip8", 0x8316)
+    MICRO("8xy7", "default", 0x8327)
+    MICRO("8xyE", "default", 0x831E)
+    MICRO("9xy0", "default", 0x9010)
+    MICRO("Annn", "default", 0xAF00)
+    MICRO("Cxkk", "default", 0xC3FF)
+    MICRO("Dxy1", "default", 0xD011)
+    MICRO("Dxy5", "default", 0xD015)
+    MICRO("Dxyf", "default", 0xD01F)
+    // v2 = 200 lands at x 8, y 8 for the in-bounds cases, these two use v4/v5 = 60/30 to cross both edges
+    MICRO("Dxy5 edge clip", "default", 0x643C, 0x651E, 0xD455)
+    MICRO("Dxy5 edge wrap", "xochip", 0x643C, 0x651E, 0xD455)
+    MICRO("Ex9E", "default", 0xE09E)
+    MICRO("ExA1", "default", 0xE0A1)
+    MICRO("Fx07", "default", 0xF307)
+    MICRO("Fx0A key held", "default", 0xF30A)
+    MICRO("Fx15", "default", 0xF015)
+    MICRO("Fx18", "default", 0xF018)
+    MICRO("Fx1E", "default", 0xF01E, 0xAF00)
+    MICRO("Fx29", "default", 0xF029)
+    MICRO("Fx33", "default", 0xF233)
+    // schip leaves I alone, otherwise the stores would walk I through memory and into the code
+    MICRO("Fx55 x=F", "schip", 0xFF55)
+    MICRO("Fx65 x=F", "schip", 0xFF65)
+    MICRO("Fx30", "default", 0xF030)
+    MICRO("Fx75 x=7", "default", 0xF775)
+    MICRO("Fx85 x=7", "default", 0xF785)
+    MICRO("00C4 scroll", "default", 0x00C4)
+    MICRO("00FB scroll", "default", 0x00FB)
+    // super-chip high resolution, the prelude switches to 128x64 first
+    c.prelude.push_back(0x00FF);
+    MICRO("Dxy0 hires", "schip", 0xD010)
+    MICRO("Dxy0 hires edge", "schip", 0x6478, 0x653C, 0xD450)
+    MICRO("00C4 scroll hires", "schip", 0x00C4)
+    MICRO("00FB scroll hires", "schip", 0x00FB)
+    MICRO("00FC scroll hires", "schip", 0x00FC)
+#undef MICRO
+    return cases;
+}
+
+// lays the case out at 0x200: prelude, the body repeated to about 1000 instructions, a jump back to the loop, the ret stub
+bool build_rom(const micro_case &c, std::vector<uint8_t> &rom)
+{
+    std::vector<uint16_t> program = c.prelude;
+    uint16_t loop = 0x200 + program.size() * 2;
+    size_t repeats = std::max<size_t>(1, 1000 / c.body.size());
+    uint16_t stub = loop + (repeats * c.body.size() + 1) * 2;
+    for (size_t i = 0; i < repeats; i++)
+    {
+        for (size_t j = 0; j < c.body.size(); j++)
+        {
+            program.push_back(c.body[j] == call_stub ? (0x2000 | stub) : c.body[j]);
+        }
+    }
+    program.push_back(0x1000 | loop);
+    program.push_back(0x00EE);
+
+    rom.clear();
+    for (size_t i = 0; i < program.size(); i++)
+    {
+        rom.push_back(program[i] >> 8);
+        rom.push_back(program[i] & 0xFF);
+    }
+    return rom.size() <= 4096 - 0x200;
+}
+
+int main(int argc, char *argv[])
+{
+    uint64_t instructions = 2000000;
+    int repetitions = 5;
+    const char *engine_choice = "all";
+    const char *filter = "";
+    for (int i = 1; i < argc; i++)
+    {
+        bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--instructions") == 0 && has_value)
+        {
+            instructions = strtoull(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--repetitions") == 0 && has_value)
+        {
+            repetitions = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--engine") == 0 && has_value)
+        {
+            engine_choice = argv[++i];
+        }
+        else if (strcmp(argv[i], "--filter") == 0 && has_value)
+        {
+            filter = argv[++i];
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--instructions N] [--repetitions N] [--engine NAME|all] [--filter TEXT]\n",
+                    argv[0]);
+            exit(1);
+        }
+    }
+
+    std::vector<micro_case> cases = build_cases();
+    // native code only runs through emulate_cycles() and needs a compiled rom, recompile --bench times it
+    for (int e = 0; e < chip8::engine_native; e++)
+    {
+        if (strcmp(engine_choice, "all") != 0 && strcmp(engine_choice, chip8::engine_name(e)) != 0)
+        {
+            continue;
+        }
+        printf("\nengine %s\n%-18s %10s %10s\n", chip8::engine_name(e), "case", "ns/instr", "handler");
+        double dispatch = 0;
+        for (size_t i = 0; i < cases.size(); i++)
+        {
+            // the dispatch baseline always runs so the handler column means the same thing under --filter
+            if (i > 0 && strstr(cases[i].name, filter) == NULL)
+            {
+                continue;
+            }
+            std::vector<uint8_t> rom;
+            if (!build_rom(cases[i], rom))
+            {
+                continue;
+            }
+            chip8 cpu;
+            cpu.seed(1);
+            cpu.load_bytes(&rom[0], rom.size());
+            cpu.set_quirks(*chip8::find_quirks(cases[i].quirks));
+            cpu.set_engine((chip8::engine_type)e);
+            // a held key keeps Fx0A from spinning and Ex9E taken
+            cpu.keypad[3] = 1;
+            cpu.keypad[7] = 1;
+            for (size_t p = 0; p < cases[i].prelude.size(); p++)
+            {
+                cpu.emulate_cycle();
+            }
+
+            // best of the repetitions, the noise in a microbenchmark is all on the slow side
+            double best = 1e30;
+            for (int rep = 0; rep < repetitions; rep++)
+            {
+                uint64_t start = now_ns();
+                for (uint64_t n = 0; n < instructions; n++)
+                {
+                    cpu.emulate_cycle();
+                }
+                best = std::min(best, (double)(now_ns() - start) / instructions);
+            }
+            if (i == 0)
+            {
+                dispatch = best;
+            }
+            if (i == 0 && strstr(cases[i].name, filter) == NULL)
+            {
+                continue;
+            }
+            printf("%-18s %10.2f %10.2f\n", cases[i].name, best, best - dispatch);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,380 @@
+#include "../chip8.hpp"
+#include "../headless.hpp"
+#include "../mapped_file.hpp"
+#include "../rom_cache.hpp"
+#include "../rom_library.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/* proposes a quirk profile for roms nobody has configured yet
+every rom runs headless under each built in profile, with the same seed and the same scripted input, each run is a
+separate job on a pool of threads so a whole library keeps every core busy
+a profile that makes the rom fault (unknown opcode, stack overflow or underflow, a jump out of the program, see
+chip8::fault_type) is the strongest evidence against it, after that a screen that stops changing long before the other
+profiles' do (a game wedged by the wrong shift or load/store semantics), then the platform the rom's opcodes point to
+usage: quirkdetect [--frames N] [--ipf N] [--seed N] [--threads N] [--ini FILE] [PATH...]
+without paths it runs roms/ and the .ch8 files in the current directory, --ini writes a rom_config.hpp section for every
+rom where the profiles made a visible difference and at least one ran clean */
+
+struct profile_run
+{
+    const quirk_profile *profile;
+    chip8::fault_type fault;
+    uint16_t fault_pc;
+    // frames run, fewer than asked for when a fault stopped it
+    uint32_t frames;
+    // the last frame the screen changed on
+    uint32_t last_change;
+    // screen hash after every frame
+    std::vector<uint64_t> screens;
+
+    profile_run() : profile(NULL), fault(chip8::fault_none), fault_pc(0), frames(0), last_change(0) {}
+};
+
+struct rom_job
+{
+    std::string path;
+    uint64_t hash;
+    // "chip8", "schip" or "xochip", see detect_platform()
+    const char *platform;
+    // loaded and predecoded once, every profile's run starts from it
+    std::shared_ptr<const rom_image> image;
+    std::vector<profile_run> runs;
+    // runs still going, the thread that finishes the last one reports the rom
+    int remaining;
+    const quirk_profile *proposal;
+    // true when every profile ran clean and drew the same frames
+    bool indifferent;
+    // true when even the proposal faulted, the rom is broken or needs something none of the profiles give it
+    bool all_faulted;
+};
+
+uint32_t frames = 3600;
+int ipf = 10;
+uint32_t seed = 1;
+std::vector<input_event> input;
+std::mutex report_mutex;
+
+std::string base_name(const std::string &path)
+{
+    size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+void run_profile(const rom_job &rom, profile_run &run)
+{
+    chip8 cpu;
+    cpu.seed(seed);
+    cpu.set_platform(rom.image->platform);
+    cpu.share_rom(rom.image->prototype);
+    cpu.set_quirks(*run.profile);
+
+    run.screens.reserve(frames);
+    run.last_change = 0;
+    size_t next_event = 0;
+    uint64_t screen = cpu.screen_hash();
+    for (run.frames = 0; run.frames < frames && cpu.fault == chip8::fault_none; run.frames++)
+    {
+        while (next_event < input.size() && input[next_event].frame <= run.frames)
+        {
+            cpu.keypad[input[next_event].key] = input[next_event].down ? 1 : 0;
+            next_event++;
+        }
+        for (int i = 0; i < ipf; i++)
+        {
+            cpu.emulate_cycle();
+        }
+        cpu.decrement_timers();
+        if (cpu.screen_hash() != screen)
+        {
+            screen = cpu.screen_hash();
+            run.last_change = run.frames;
+        }
+        run.screens.push_back(screen);
+    }
+    run.fault = cpu.fault;
+    run.fault_pc = cpu.fault_pc;
+}
+
+// how many runs drew exactly the frames this one did
+int agreement(const rom_job &rom, const profile_run &run)
+{
+    int count = 0;
+    for (size_t i = 0; i < rom.runs.size(); i++)
+    {
+        count += rom.runs[i].screens == run.screens;
+    }
+    return count;
+}
+
+// true if a is the more plausible profile
+bool more_plausible(const rom_job &rom, const profile_run &a, const profile_run &b)
+{
+    if ((a.fault == chip8::fault_none) != (b.fault == chip8::fault_none))
+    {
+        return a.fault == chip8::fault_none;
+    }
+    if (a.frames != b.frames)
+    {
+        return a.frames > b.frames;
+    }
+    // a tenth of the run's slack so a title screen that stays up a little longer doesn't decide it
+    uint32_t slack = frames / 10;
+    if (a.last_change > b.last_change + slack || b.last_change > a.last_change + slack)
+    {
+        return a.last_change > b.last_change;
+    }
+    bool a_prior = strcmp(a.profile->name, rom.platform) == 0;
+    bool b_prior = strcmp(b.profile->name, rom.platform) == 0;
+    if (a_prior != b_prior)
+    {
+        return a_prior;
+    }
+    return agreement(rom, a) > agreement(rom, b);
+}
+
+void decide(rom_job &rom)
+{
+    const profile_run *best = &rom.runs[0];
+    rom.indifferent = true;
+    for (size_t i = 0; i < rom.runs.size(); i++)
+    {
+        const profile_run &run = rom.runs[i];
+        rom.indifferent = rom.indifferent && run.fault == chip8::fault_none && run.screens == rom.runs[0].screens;
+        if (more_plausible(rom, run, *best))
+        {
+            best = &run;
+        }
+    }
+    rom.proposal = best->profile;
+    rom.all_faulted = best->fault != chip8::fault_none;
+}
+
+void report(const rom_job &rom)
+{
+    printf("%s [%016llx] %s -> %s%s\n", rom.path.c_str(), (unsigned long long)rom.hash, rom.platform, rom.proposal->name,
+           rom.indifferent ? " (no profile made a difference)" : rom.all_faulted ? " (every profile faulted)" : "");
+    if (rom.indifferent)
+    {
+        return;
+    }
+    const profile_run *chosen = NULL;
+    for (size_t i = 0; i < rom.runs.size(); i++)
+    {
+        chosen = rom.runs[i].profile == rom.proposal ? &rom.runs[i] : chosen;
+    }
+    for (size_t i = 0; i < rom.runs.size(); i++)
+    {
+        const profile_run &run = rom.runs[i];
+        printf("    %-8s", run.profile->name);
+        if (run.fault != chip8::fault_none)
+        {
+            printf(" %s at %03X in frame %u", chip8::fault_name(run.fault), run.fault_pc, run.frames);
+        }
+        else
+        {
+            printf(" ok, screen last changed in frame %u", run.last_change);
+        }
+        if (&run != chosen)
+        {
+            size_t common = std::min(run.screens.size(), chosen->screens.size());
+            size_t frame = std::mismatch(run.screens.begin(), run.screens.begin() + common, chosen->screens.begin()).first -
+                           run.screens.begin();
+            if (frame < common)
+            {
+                printf(", differs from %s from frame %zu", chosen->profile->name, frame);
+            }
+            else if (run.fault == chip8::fault_none)
+            {
+                printf(", same as %s", chosen->profile->name);
+            }
+        }
+        printf("\n");
+    }
+}
+
+void worker(std::vector<rom_job> &roms, std::atomic<size_t> &next_job, size_t profile_count)
+{
+    for (size_t job = next_job++; job < roms.size() * profile_count; job = next_job++)
+    {
+        rom_job &rom = roms[job / profile_count];
+        profile_run &run = rom.runs[job % profile_count];
+        run_profile(rom, run);
+
+        std::lock_guard<std::mutex> lock(report_mutex);
+        if (--rom.remaining == 0)
+        {
+            decide(rom);
+            report(rom);
+            fflush(stdout);
+            // the traces are only needed to compare the runs of one rom, a library's worth would add up
+            for (size_t i = 0; i < rom.runs.size(); i++)
+            {
+                std::vector<uint64_t>().swap(rom.runs[i].screens);
+            }
+        }
+    }
+}
+
+bool write_ini(const char *filename, const std::vector<rom_job> &roms)
+{
+    FILE *file = fopen(filename, "w");
+    if (file == NULL)
+    {
+        return false;
+    }
+    fprintf(file, "; quirk profiles proposed by quirkdetect, %u frames at %d instructions per frame\n", frames, ipf);
+    for (size_t i = 0; i < roms.size(); i++)
+    {
+        if (roms[i].indifferent || roms[i].all_faulted)
+        {
+            continue;
+        }
+        fprintf(file, "\n[%016llx]\nname = %s\nquirks = %s\n", (unsigned long long)roms[i].hash,
+                base_name(roms[i].path).c_str(), roms[i].proposal->name);
+        if (strcmp(roms[i].platform, "xochip") == 0)
+        {
+            fprintf(file, "platform = xochip\n");
+        }
+    }
+    return fclose(file) == 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int threads = std::thread::hardware_concurrency();
+    const char *ini_file = NULL;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; i++)
+    {
+        bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--frames") == 0 && has_value)
+        {
+            frames = strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--ipf") == 0 && has_value)
+        {
+            ipf = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--seed") == 0 && has_value)
+        {
+            seed = strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && has_value)
+        {
+            threads = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--ini") == 0 && has_value)
+        {
+            ini_file = argv[++i];
+        }
+        else if (argv[i][0] == '-')
+        {
+            fprintf(stderr, "usage: %s [--frames N] [--ipf N] [--seed N] [--threads N] [--ini FILE] [PATH...]\n", argv[0]);
+            exit(1);
+        }
+        else
+        {
+            std::vector<std::string> files = list_rom_files(argv[i]);
+            if (files.empty())
+            {
+                files.push_back(argv[i]);
+            }
+            paths.insert(paths.end(), files.begin(), files.end());
+        }
+    }
+    if (paths.empty())
+    {
+        paths = list_rom_files("roms");
+        std::vector<std::string> top = list_rom_files(".");
+        for (size_t i = 0; i < top.size(); i++)
+        {
+            if (top[i].size() > 4 && top[i].compare(top[i].size() - 4, 4, ".ch8") == 0)
+            {
+                paths.push_back(top[i]);
+            }
+        }
+    }
+    if (frames < 1 || ipf < 1)
+    {
+        fprintf(stderr, "frames and ipf must be positive\n");
+        exit(1);
+    }
+    threads = std::max(threads, 1);
+
+    std::vector<const quirk_profile *> profiles;
+    for (const quirk_profile *p = chip8::quirk_profiles(); p->name != NULL; p++)
+    {
+        profiles.push_back(p);
+    }
+    input = scripted_input(frames, seed);
+
+    std::vector<rom_job> roms;
+    roms.reserve(paths.size());
+    for (size_t i = 0; i < paths.size(); i++)
+    {
+        mapped_file file;
+        size_t limit = 0x10000 - 0x200;
+        if (!file.open(paths[i].c_str()) || file.size() == 0 || file.size() > limit)
+        {
+            fprintf(stderr, "skipping %s, not a readable rom\n", paths[i].c_str());
+            continue;
+        }
+        roms.push_back(rom_job());
+        rom_job &rom = roms.back();
+        rom.path = paths[i];
+        rom.hash = content_hash(file.data(), file.size());
+        rom.platform = detect_platform(file.data(), file.size());
+        rom.image = load_rom_image(paths[i].c_str(),
+                                   strcmp(rom.platform, "xochip") == 0 ? chip8::platform_xochip : chip8::platform_chip8);
+        if (!rom.image)
+        {
+            fprintf(stderr, "skipping %s, too big for chip8 and no xo-chip opcodes\n", paths[i].c_str());
+            roms.pop_back();
+            continue;
+        }
+        rom.remaining = profiles.size();
+        rom.proposal = NULL;
+        rom.indifferent = false;
+        rom.all_faulted = false;
+        for (size_t p = 0; p < profiles.size(); p++)
+        {
+            profile_run run;
+            run.profile = profiles[p];
+            rom.runs.push_back(run);
+        }
+    }
+
+    // jobs go rom by rom, so the profiles of one rom run side by side and it is reported as soon as they are done
+    std::atomic<size_t> next_job(0);
+    std::vector<std::thread> pool;
+    for (int i = 0; i < threads; i++)
+    {
+        pool.push_back(std::thread(worker, std::ref(roms), std::ref(next_job), profiles.size()));
+    }
+    for (size_t i = 0; i < pool.size(); i++)
+    {
+        pool[i].join();
+    }
+
+    int indifferent = 0;
+    for (size_t i = 0; i < roms.size(); i++)
+    {
+        indifferent += roms[i].indifferent;
+    }
+    printf("%zu roms, %zu profiles each, %d unaffected by the choice\n", roms.size(), profiles.size(), indifferent);
+    if (ini_file != NULL && !write_ini(ini_file, roms))
+    {
+        fprintf(stderr, "could not write %s\n", ini_file);
+        exit(1);
+    }
+    return 0;
+}
@@ -0,0 +1,200 @@
+#include "../chip8.hpp"
+#include "../frame_timing.hpp"
+#include "../headless.hpp"
+#include "../mapped_file.hpp"
+#include "../recompiler.hpp"
+#include "../rom_cache.hpp"
+#include "../rom_library.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// compiles a rom ahead of time into the native code cache (see recompiler.hpp) and checks the result
+// usage: recompile ROM [--platform chip8|xochip] [--quirks NAME] [--cache DIR] [--source] [--verify FRAMES] [--bench FRAMES]
+//                      [--ipf N] [--seed N]
+// --source prints the generated C++ instead, --verify runs the rom under scripted input on the table engine and natively
+// side by side and compares the state hashes after every frame, --bench times predecode against native
+
+void usage(const char *program)
+{
+    fprintf(stderr, "usage: %s ROM [--platform chip8|xochip] [--quirks NAME] [--cache DIR] [--source] [--verify FRAMES] "
+                    "[--bench FRAMES] [--ipf N] [--seed N]\n",
+            program);
+    exit(1);
+}
+
+// one frame the way run_headless() does it, the input events up to this frame first
+void run_frame(chip8 &cpu, const std::vector<input_event> &input, size_t &next_event, uint32_t frame, int ipf)
+{
+    while (next_event < input.size() && input[next_event].frame <= frame)
+    {
+        cpu.keypad[input[next_event].key] = input[next_event].down ? 1 : 0;
+        next_event++;
+    }
+    for (int done = 0; done < ipf;)
+    {
+        done += cpu.emulate_cycles(ipf - done);
+    }
+    cpu.decrement_timers();
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2 || argv[1][0] == '-')
+    {
+        usage(argv[0]);
+    }
+    const char *platform_choice = NULL;
+    const quirk_profile *quirks = chip8::find_quirks("default");
+    std::string cache_dir;
+    bool source = false;
+    uint32_t verify_frames = 0;
+    uint32_t bench_frames = 0;
+    int ipf = 10;
+    uint32_t seed = 1;
+    for (int i = 2; i < argc; i++)
+    {
+        bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--platform") == 0 && has_value)
+        {
+            platform_choice = argv[++i];
+        }
+        else if (strcmp(argv[i], "--quirks") == 0 && has_value)
+        {
+            quirks = chip8::find_quirks(argv[++i]);
+            if (quirks == NULL)
+            {
+                fprintf(stderr, "unknown quirk profile %s\n", argv[i]);
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--cache") == 0 && has_value)
+        {
+            cache_dir = argv[++i];
+        }
+        else if (strcmp(argv[i], "--source") == 0)
+        {
+            source = true;
+        }
+        else if (strcmp(argv[i], "--verify") == 0 && has_value)
+        {
+            verify_frames = strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--bench") == 0 && has_value)
+        {
+            bench_frames = strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--ipf") == 0 && has_value)
+        {
+            ipf = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--seed") == 0 && has_value)
+        {
+            seed = strtoul(argv[++i], NULL, 10);
+        }
+        else
+        {
+            usage(argv[0]);
+        }
+    }
+
+    mapped_file rom;
+    if (!rom.open(argv[1]))
+    {
+        fprintf(stderr, "could not read %s\n", argv[1]);
+        exit(1);
+    }
+    chip8::platform_type platform = chip8::platform_chip8;
+    if (platform_choice != NULL)
+    {
+        platform = chip8::find_platform(platform_choice);
+        if (platform == chip8::platform_count)
+        {
+            fprintf(stderr, "unknown platform %s\n", platform_choice);
+            exit(1);
+        }
+    }
+    else if (strcmp(detect_platform(rom.data(), rom.size()), "xochip") == 0)
+    {
+        platform = chip8::platform_xochip;
+    }
+
+    if (source)
+    {
+        write_native_source(stdout, rom.data(), rom.size(), platform, content_hash(rom.data(), rom.size()));
+        return 0;
+    }
+    if (cache_dir.empty())
+    {
+        cache_dir = default_native_cache();
+    }
+    uint64_t start = now_ns();
+    std::shared_ptr<const native_program> program = load_native(rom.data(), rom.size(), platform, cache_dir.c_str());
+    if (!program)
+    {
+        exit(1);
+    }
+    printf("%s, %zu blocks, ready in %.1f ms\n",
+           native_cache_path(cache_dir.c_str(), content_hash(rom.data(), rom.size()), platform).c_str(),
+           program->blocks.size(), (now_ns() - start) / 1e6);
+
+    chip8 prototype;
+    prototype.seed(seed);
+    prototype.set_platform(platform);
+    if (!prototype.load_bytes(rom.data(), rom.size()))
+    {
+        fprintf(stderr, "%s does not fit in memory\n", argv[1]);
+        exit(1);
+    }
+    prototype.set_quirks(*quirks);
+
+    if (verify_frames > 0)
+    {
+        chip8 reference = prototype;
+        chip8 native = prototype;
+        reference.set_engine(chip8::engine_table);
+        native.set_native(program);
+        std::vector<input_event> input = scripted_input(verify_frames, seed);
+        size_t reference_event = 0;
+        size_t native_event = 0;
+        for (uint32_t frame = 0; frame < verify_frames; frame++)
+        {
+            run_frame(reference, input, reference_event, frame, ipf);
+            run_frame(native, input, native_event, frame, ipf);
+            if (reference.state_hash() != native.state_hash() || reference.fault != native.fault)
+            {
+                chip8_registers expected = reference.get_registers();
+                chip8_registers actual = native.get_registers();
+                printf("frame %u differs: pc %03X/%03X I %03X/%03X sp %d/%d, fault %s/%s\n", frame, expected.pc, actual.pc,
+                       expected.I, actual.I, expected.sp, actual.sp, chip8::fault_name(reference.fault),
+                       chip8::fault_name(native.fault));
+                exit(1);
+            }
+        }
+        printf("%u frames match the table engine, state %016llx\n", verify_frames,
+               (unsigned long long)native.state_hash());
+    }
+
+    if (bench_frames > 0)
+    {
+        headless_options options;
+        options.ipf = ipf;
+        options.frames = bench_frames;
+        options.input = scripted_input(bench_frames, seed);
+        for (int engine = chip8::engine_predecode; engine <= chip8::engine_native; engine++)
+        {
+            chip8 cpu = prototype;
+            cpu.set_engine((chip8::engine_type)engine);
+            if (engine == chip8::engine_native)
+            {
+                cpu.set_native(program);
+            }
+            uint64_t begin = now_ns();
+            headless_result result = run_headless(cpu, options);
+            uint64_t elapsed = now_ns() - begin;
+            printf("%-10s %8.2f ns/instruction, state %016llx\n", chip8::engine_name(engine),
+                   (double)elapsed / result.instructions, (unsigned long long)result.state_hash);
+        }
+    }
+    return 0;
+}
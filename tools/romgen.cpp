@@ -0,0 +1,356 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+#include <vector>
+
+/* synthetic rom generator for stress tests and benchmarks
+emits a valid chip8 program: a main loop that runs forever, built from small idioms (alu ops, memory stores and loads,
+sprite draws, subroutine calls down a chain of configurable depth, skips, forward jumps and self modifying stores that
+rewrite the immediate of a 6xkk elsewhere in the loop)
+every idiom leaves the machine somewhere safe: skips only ever guard a single alu op, I is reloaded before each use, and
+stores go either to scratch memory at 0xE00 or over a whole patch slot instruction, so the program never runs into data
+or corrupts itself beyond what was asked for
+usage: romgen -o FILE [--size BYTES] [--seed N] [--branch-density F] [--draw-rate F] [--mem-rate F] [--call-rate F]
+              [--call-depth N] [--smc-rate F] */
+
+const uint16_t scratch = 0xE00;
+
+uint32_t rng_state = 1;
+
+uint32_t next_random()
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+int random_below(int limit)
+{
+    return (int)(next_random() % (uint32_t)limit);
+}
+
+double random_unit()
+{
+    return (next_random() >> 8) / 16777216.0;
+}
+
+enum item_kind
+{
+    item_plain,
+    // words[0] becomes 1NNN to the item in target
+    item_jump,
+    // words[2] becomes ANNN pointing at the patch slot item in target
+    item_patch,
+    // a 6xkk that patch items rewrite
+    item_slot,
+};
+
+struct item
+{
+    item_kind kind;
+    std::vector<uint16_t> words;
+    int target;
+};
+
+uint16_t random_alu_op()
+{
+    int x = random_below(16);
+    int y = random_below(16);
+    switch (random_below(6))
+    {
+    case 0:
+        return 0x6000 | x << 8 | random_below(256);
+    case 1:
+        return 0x7000 | x << 8 | random_below(256);
+    case 2:
+    {
+        static const uint8_t variants[] = {0x0, 0x1, 0x2, 0x3, 0x4, 0x5, 0x6, 0x7, 0xE};
+        return 0x8000 | x << 8 | y << 4 | variants[random_below(9)];
+    }
+    case 3:
+        return 0xC000 | x << 8 | random_below(256);
+    case 4:
+        return random_below(2) ? (0xF007 | x << 8) : (0xF015 | x << 8);
+    default:
+        return 0xF01E | x << 8;
+    }
+}
+
+uint16_t random_skip_op()
+{
+    int x = random_below(16);
+    int y = random_below(16);
+    switch (random_below(5))
+    {
+    case 0:
+        return 0x3000 | x << 8 | random_below(256);
+    case 1:
+        return 0x4000 | x << 8 | random_below(256);
+    case 2:
+        return 0x5000 | x << 8 | y << 4;
+    case 3:
+        return 0x9000 | x << 8 | y << 4;
+    default:
+        return random_below(2) ? (0xE09E | x << 8) : (0xE0A1 | x << 8);
+    }
+}
+
+void plain(std::vector<item> &items, const std::vector<uint16_t> &words)
+{
+    item next;
+    next.kind = item_plain;
+    next.words = words;
+    next.target = -1;
+    items.push_back(next);
+}
+
+// a run of alu ops, the filler between the interesting idioms
+void add_alu(std::vector<item> &items, int count)
+{
+    std::vector<uint16_t> words;
+    for (int i = 0; i < count; i++)
+    {
+        words.push_back(random_alu_op());
+    }
+    plain(items, words);
+}
+
+size_t words_in(const std::vector<item> &items)
+{
+    size_t total = 0;
+    for (size_t i = 0; i < items.size(); i++)
+    {
+        total += items[i].words.size();
+    }
+    return total;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *output = NULL;
+    size_t size = 2048;
+    double branch_density = 0.10;
+    double draw_rate = 0.05;
+    double mem_rate = 0.05;
+    double call_rate = 0.02;
+    double smc_rate = 0.0;
+    int call_depth = 4;
+    for (int i = 1; i < argc; i++)
+    {
+        bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "-o") == 0 && has_value)
+        {
+            output = argv[++i];
+        }
+        else if (strcmp(argv[i], "--size") == 0 && has_value)
+        {
+            size = strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--seed") == 0 && has_value)
+        {
+            rng_state = strtoul(argv[++i], NULL, 10) | 1;
+        }
+        else if (strcmp(argv[i], "--branch-density") == 0 && has_value)
+        {
+            branch_density = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--draw-rate") == 0 && has_value)
+        {
+            draw_rate = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--mem-rate") == 0 && has_value)
+        {
+            mem_rate = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--call-rate") == 0 && has_value)
+        {
+            call_rate = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--call-depth") == 0 && has_value)
+        {
+            call_depth = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--smc-rate") == 0 && has_value)
+        {
+            smc_rate = atof(argv[++i]);
+        }
+        else
+        {
+            output = NULL;
+            break;
+        }
+    }
+    if (output == NULL)
+    {
+        fprintf(stderr, "usage: %s -o FILE [--size BYTES] [--seed N] [--branch-density F] [--draw-rate F] "
+                        "[--mem-rate F] [--call-rate F] [--call-depth N] [--smc-rate F]\n",
+                argv[0]);
+        exit(1);
+    }
+    // code has to end below the scratch area, the main loop jump and the subroutines need some room too
+    if (size < 64 || size > scratch - 0x200)
+    {
+        fprintf(stderr, "size must be between 64 and %d bytes\n", scratch - 0x200);
+        exit(1);
+    }
+    // the main loop itself takes one stack level
+    if (call_depth < 0 || call_depth > 15)
+    {
+        fprintf(stderr, "call depth must be between 0 and 15\n");
+        exit(1);
+    }
+
+    // subroutines come after the main loop, each is a few alu ops, a call to the next one, then 00EE
+    size_t subroutine_words = call_depth * 6;
+    // the main loop needs its jump back plus at least one word, deep chains don't fit in small roms
+    if (size / 2 < subroutine_words + 2)
+    {
+        fprintf(stderr, "a call depth of %d needs a size of at least %zu bytes\n", call_depth, (subroutine_words + 2) * 2);
+        exit(1);
+    }
+    size_t main_words = size / 2 - subroutine_words - 1;
+
+    std::vector<item> items;
+    std::vector<int> slots;
+    int counts[7] = {0, 0, 0, 0, 0, 0, 0};
+    while (words_in(items) + 8 < main_words)
+    {
+        double roll = random_unit();
+        if ((roll -= branch_density / 2) < 0)
+        {
+            // skip guarding exactly one alu op
+            std::vector<uint16_t> words;
+            words.push_back(random_skip_op());
+            words.push_back(random_alu_op());
+            plain(items, words);
+            counts[0]++;
+        }
+        else if ((roll -= branch_density / 2) < 0)
+        {
+            // forward jump, the target is filled in once we know where later items are
+            item next;
+            next.kind = item_jump;
+            next.words.push_back(0x1000);
+            next.target = -1;
+            items.push_back(next);
+            counts[1]++;
+        }
+        else if ((roll -= draw_rate) < 0)
+        {
+            std::vector<uint16_t> words;
+            words.push_back(0xA000 | random_below(16) * 5);
+            words.push_back(0xD000 | random_below(16) << 8 | random_below(16) << 4 | (1 + random_below(5)));
+            plain(items, words);
+            counts[2]++;
+        }
+        else if ((roll -= mem_rate) < 0)
+        {
+            std::vector<uint16_t> words;
+            words.push_back(0xA000 | (scratch + random_below(128)));
+            static const uint16_t memory_ops[] = {0xF033, 0xF055, 0xF065};
+            words.push_back(memory_ops[random_below(3)] | random_below(16) << 8);
+            plain(items, words);
+            counts[3]++;
+        }
+        else if ((roll -= call_rate) < 0 && call_depth > 0)
+        {
+            // the address is patched below once the subroutines are placed
+            plain(items, std::vector<uint16_t>(1, 0x2000));
+            counts[4]++;
+        }
+        else if ((roll -= smc_rate) < 0 && !slots.empty())
+        {
+            // v0:v1 = a fresh 6xkk for the slot's register, stored over the slot, then I goes back to scratch
+            item next;
+            next.kind = item_patch;
+            next.target = slots[random_below(slots.size())];
+            uint16_t slot_op = items[next.target].words[0];
+            next.words.push_back(0x6000 | (slot_op >> 8));
+            next.words.push_back(0x6100 | random_below(256));
+            next.words.push_back(0xA000);
+            next.words.push_back(0xF155);
+            next.words.push_back(0xA000 | scratch);
+            items.push_back(next);
+            counts[5]++;
+        }
+        else if (smc_rate > 0 && slots.size() < 16 && random_below(8) == 0)
+        {
+            // patch slots use v2..vd so the v0/v1 staging of a patch never clobbers them
+            item next;
+            next.kind = item_slot;
+            next.words.push_back(0x6000 | (2 + random_below(14)) << 8 | random_below(256));
+            next.target = -1;
+            slots.push_back(items.size());
+            items.push_back(next);
+            counts[6]++;
+        }
+        else
+        {
+            add_alu(items, 1 + random_below(4));
+        }
+    }
+
+    // lay out: main items from 0x200, the jump back, then the subroutine chain
+    std::vector<uint16_t> addresses(items.size());
+    uint16_t address = 0x200;
+    for (size_t i = 0; i < items.size(); i++)
+    {
+        addresses[i] = address;
+        address += items[i].words.size() * 2;
+    }
+    uint16_t loop_jump = address;
+    uint16_t first_subroutine = loop_jump + 2;
+
+    std::vector<uint16_t> program;
+    for (size_t i = 0; i < items.size(); i++)
+    {
+        item &current = items[i];
+        if (current.kind == item_jump)
+        {
+            // any later item, or the loop jump if this is the last one
+            size_t target = i + 1 + random_below(std::min<size_t>(8, items.size() - i));
+            current.words[0] = 0x1000 | (target < items.size() ? addresses[target] : loop_jump);
+        }
+        else if (current.kind == item_patch)
+        {
+            current.words[2] = 0xA000 | addresses[current.target];
+        }
+        else if (current.words.size() == 1 && current.words[0] == 0x2000)
+        {
+            current.words[0] = 0x2000 | first_subroutine;
+        }
+        program.insert(program.end(), current.words.begin(), current.words.end());
+    }
+    program.push_back(0x1200);
+    for (int depth = 0; depth < call_depth; depth++)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            program.push_back(random_alu_op());
+        }
+        // each subroutine is 6 words, so the next one starts 12 bytes on, the deepest one has no call
+        uint16_t next = first_subroutine + (depth + 1) * 12;
+        program.push_back(depth + 1 < call_depth ? (0x2000 | next) : random_alu_op());
+        program.push_back(0x00EE);
+    }
+
+    FILE *file = fopen(output, "wb");
+    if (file == NULL)
+    {
+        fprintf(stderr, "could not write %s\n", output);
+        exit(1);
+    }
+    for (size_t i = 0; i < program.size(); i++)
+    {
+        fputc(program[i] >> 8, file);
+        fputc(program[i] & 0xFF, file);
+    }
+    fclose(file);
+
+    fprintf(stderr, "%zu bytes: %d skips, %d jumps, %d draws, %d memory ops, %d calls (depth %d), %d patches of %d slots\n",
+            program.size() * 2, counts[0], counts[1], counts[2], counts[3], counts[4], call_depth, counts[5], counts[6]);
+    return 0;
+}
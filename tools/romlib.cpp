@@ -0,0 +1,59 @@
+#include "../rom_library.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <sys/stat.h>
+
+// indexes roms into a library file, directories are scanned one level deep
+// usage: romlib INDEX PATH...
+// unchanged files are answered from the index without being read, so rerunning over a large collection is cheap
+
+void scan_path(rom_library &library, const std::string &path)
+{
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0)
+    {
+        fprintf(stderr, "cannot stat %s\n", path.c_str());
+        return;
+    }
+    if (!S_ISDIR(info.st_mode))
+    {
+        const rom_entry *entry = library.scan(path.c_str());
+        if (entry == NULL)
+        {
+            fprintf(stderr, "cannot read %s\n", path.c_str());
+            return;
+        }
+        printf("%016llx %6zu %-7s %s\n", (unsigned long long)entry->hash, entry->size, entry->platform.c_str(),
+               entry->path.c_str());
+        return;
+    }
+
+    std::vector<std::string> files = list_rom_files(path.c_str());
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        scan_path(library, files[i]);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc <= 2)
+    {
+        fprintf(stderr, "usage: %s INDEX PATH...\n", argv[0]);
+        exit(1);
+    }
+
+    rom_library library;
+    library.load(argv[1]);
+    for (int i = 2; i < argc; i++)
+    {
+        scan_path(library, argv[i]);
+    }
+    if (!library.save())
+    {
+        fprintf(stderr, "could not write %s\n", argv[1]);
+        exit(1);
+    }
+    return 0;
+}